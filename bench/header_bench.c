@@ -0,0 +1,135 @@
+#include "headers.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 2000000
+
+
+typedef struct {
+    int status_code;
+    const char *content_type;
+    const char *other;
+} HeaderCase;
+
+// what the handlers send most: pages, redirects, error pages and empty answers to API calls
+static const HeaderCase CASES[] = {
+    {200, "text/html", "Content-Length: 6484\r\n"},
+    {200, "text/css", "Content-Length: 1216\r\n"},
+    {303, NULL, "Location: /user/auth\r\n"},
+    {404, "text/html", "Content-Length: 387\r\n"},
+    {204, NULL, "Set-Cookie: session=3f9a1c0d8e7b6a5f4e3d2c1b0a9f8e7d; Path=/; HttpOnly; SameSite=Strict\r\n"},
+    {400, "application/json", "Content-Length: 80\r\n"},
+};
+
+#define CASE_COUNT (sizeof(CASES) / sizeof(CASES[0]))
+
+
+// send_headers as it was before the status line table
+static int legacy_format_headers(char *response_header, int status_code, const char *content_type, bool keep_alive,
+                                 const char *other) {
+    char content_type_h[64] = "";
+    if (content_type) {
+        snprintf(content_type_h, sizeof(content_type_h), "Content-Type: %s\r\n", content_type);
+    }
+    if (!other) other = "";
+
+    const char *status_text;
+    switch (status_code) {
+        case 200:
+            status_text = "OK";
+            break;
+        case 201:
+            status_text = "Created";
+            break;
+        case 204:
+            status_text = "No Content";
+            break;
+        case 303:
+            status_text = "See Other";
+            break;
+        case 400:
+            status_text = "Bad Request";
+            break;
+        case 401:
+            status_text = "Unauthorized";
+            break;
+        case 404:
+            status_text = "Not Found";
+            break;
+        case 405:
+            status_text = "Method Not Allowed";
+            break;
+        case 409:
+            status_text = "Conflict";
+            break;
+        case 415:
+            status_text = "Unsupported Media Type";
+            break;
+        default:
+            status_text = "Internal Server Error";
+            status_code = 500;
+    }
+
+    const char *connection_h = keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+    const char *empty_body_h = !content_type && status_code != 204 ? "Content-Length: 0\r\n" : "";
+
+    return sprintf(response_header, "HTTP/1.1 %d %s\r\n"
+                                    "%s"
+                                    "%s"
+                                    "%s"
+                                    "%s"
+                                    "\r\n",
+                   status_code, status_text, content_type_h, connection_h, empty_body_h, other);
+}
+
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static double run_legacy() {
+    char buffer[HEADER_BLOCK_SIZE];
+    size_t total = 0;
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        const HeaderCase *c = &CASES[i % CASE_COUNT];
+        total += legacy_format_headers(buffer, c->status_code, c->content_type, i & 1, c->other);
+        __asm__ volatile("" : : "r"(buffer) : "memory");
+    }
+    double elapsed = now_ns() - start;
+    if (total == 0) puts("");
+    return elapsed / ITERATIONS;
+}
+
+
+static double run_current() {
+    char buffer[HEADER_BLOCK_SIZE];
+    size_t total = 0;
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        const HeaderCase *c = &CASES[i % CASE_COUNT];
+        total += format_header_block(buffer, c->status_code, c->content_type, i & 1, c->other);
+        __asm__ volatile("" : : "r"(buffer) : "memory");
+    }
+    double elapsed = now_ns() - start;
+    if (total == 0) puts("");
+    return elapsed / ITERATIONS;
+}
+
+
+int main() {
+    if (!headers_init()) {
+        return 1;
+    }
+    printf("%zu header shapes, %d iterations\n\n", CASE_COUNT, ITERATIONS);
+
+    run_legacy();
+    printf("%-32s %6.1f ns/response\n", "switch + snprintf/sprintf", run_legacy());
+    run_current();
+    printf("%-32s %6.1f ns/response\n", "status table + memcpy, with Date", run_current());
+    return 0;
+}
\ No newline at end of file
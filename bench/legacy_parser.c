@@ -0,0 +1,117 @@
+#include "legacy_parser.h"
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+
+// header end detection as receive_full_request did it after every recv
+size_t legacy_frame_request(const char *buffer, size_t length) {
+    const char *header_end = strstr(buffer, "\r\n\r\n");
+    if (!header_end) {
+        return 0;
+    }
+    size_t content_length = 0;
+    const char *content_length_header = strstr(buffer, "Content-Length:");
+    if (content_length_header) {
+        content_length_header += 15;
+        while (isspace(*content_length_header)) content_length_header++;
+        content_length = strtoul(content_length_header, NULL, 10);
+    }
+    size_t request_length = (size_t)(header_end + 4 - buffer) + content_length;
+    return length >= request_length ? request_length : 0;
+}
+
+
+static int convert_method_str(const char *method) {
+    if (strcmp(method, "GET") == 0) {
+        return 0;
+    } else if (strcmp(method, "POST") == 0) {
+        return 1;
+    } else if (strcmp(method, "DELETE") == 0) {
+        return 2;
+    } else if (strcmp(method, "PATCH") == 0) {
+        return 3;
+    }
+    return -1;
+}
+
+
+bool legacy_parse_http_request(char *buffer, LegacyHttpRequest *request) {
+    char *req_line_end = strstr(buffer, "\r\n");
+    if (!req_line_end) {
+        return false;
+    }
+    *req_line_end = '\0';
+
+    char *method_str = strtok(buffer, " ");
+    char *path = strtok(NULL, " ");
+    char *protocol = strtok(NULL, " ");
+    char *query_string_path = strtok(path, "?");
+    char *query_string = NULL;
+    if (query_string_path) {
+        path = query_string_path;
+        query_string = strtok(NULL, "\r");
+    }
+    if (!method_str || !path || !protocol) {
+        return false;
+    }
+
+    if (strlen(method_str) >= 8 ||
+        strlen(path) >= sizeof(request->path) ||
+        path[0] != '/' ||
+        strlen(protocol) >= sizeof(request->protocol) ||
+        strncmp(protocol, "HTTP/", 5) != 0) {
+        return false;
+    }
+    request->method = convert_method_str(method_str);
+    strcpy(request->path, path);
+    if (query_string) request->query_string = strdup(query_string);
+    strcpy(request->protocol, protocol);
+
+    *req_line_end = '\r';
+    req_line_end += 2;
+    char *headers_end = strstr(req_line_end, "\r\n\r\n");
+    if (headers_end) {
+        *headers_end = '\0';
+
+        size_t headers_length = headers_end - req_line_end;
+        request->headers = malloc(headers_length + 1);
+        if (!request->headers) {
+            if (request->query_string) free(request->query_string);
+            return false;
+        }
+        strcpy(request->headers, req_line_end);
+
+        headers_end += 4;
+        size_t body_length = strlen(headers_end);
+        if (body_length == 0) {
+            request->body = NULL;
+        } else {
+            request->body = malloc(body_length + 1);
+            if (!request->body) {
+                if (request->query_string) free(request->query_string);
+                return false;
+            }
+            strcpy(request->body, headers_end);
+        }
+    } else {
+        if (!strstr(req_line_end, "\r\n")) {
+            return false;
+        }
+        request->headers = NULL;
+    }
+    return true;
+}
+
+
+void legacy_free_http_request(LegacyHttpRequest *request) {
+    if (request->query_string) {
+        free(request->query_string);
+    }
+    if (request->headers) {
+        free(request->headers);
+    }
+    if (request->body) {
+        free(request->body);
+    }
+}
\ No newline at end of file
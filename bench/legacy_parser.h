@@ -0,0 +1,24 @@
+#ifndef HTTP_SERVER_LEGACY_PARSER_H
+#define HTTP_SERVER_LEGACY_PARSER_H
+
+#include <stddef.h>
+
+
+// the strtok/strstr based parser the server used before the incremental one, kept only for comparison
+typedef struct {
+    int method;
+    char *query_string;
+    char path[256];
+    char protocol[16];
+    char *headers;
+    char *body;
+} LegacyHttpRequest;
+
+size_t legacy_frame_request(const char *buffer, size_t length);
+
+bool legacy_parse_http_request(char *buffer, LegacyHttpRequest *request);
+
+void legacy_free_http_request(LegacyHttpRequest *request);
+
+
+#endif
@@ -0,0 +1,257 @@
+#include "memchr_parser.h"
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+
+static int convert_method_str(const char *method, size_t length) {
+    if (length == 3 && memcmp(method, "GET", 3) == 0) {
+        return GET;
+    } else if (length == 4 && memcmp(method, "POST", 4) == 0) {
+        return POST;
+    } else if (length == 6 && memcmp(method, "DELETE", 6) == 0) {
+        return DELETE;
+    } else if (length == 5 && memcmp(method, "PATCH", 5) == 0) {
+        return PATCH;
+    }
+    return -1;
+}
+
+
+void memchr_parser_reset(MemchrRequestParser *parser) {
+    memset(parser, 0, sizeof(MemchrRequestParser));
+}
+
+
+// strict decimal, so a malformed length can't desync the framing of pipelined requests
+static bool parse_content_length(const char *value, const char *end, size_t *content_length) {
+    while (value < end && (*value == ' ' || *value == '\t')) value++;
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    if (value == end) {
+        return false;
+    }
+
+    size_t length = 0;
+    for (; value < end; ++value) {
+        if (*value < '0' || *value > '9' || length > (SIZE_MAX - 9) / 10) {
+            return false;
+        }
+        length = length * 10 + (*value - '0');
+    }
+    *content_length = length;
+    return true;
+}
+
+
+static const char *KNOWN_HEADERS[HDR_KNOWN_COUNT] = {
+        [HDR_HOST] = "Host",
+        [HDR_CONNECTION] = "Connection",
+        [HDR_CONTENT_LENGTH] = "Content-Length",
+        [HDR_CONTENT_TYPE] = "Content-Type",
+        [HDR_COOKIE] = "Cookie",
+        [HDR_X_CSRF_TOKEN] = "X-CSRF-Token",
+        [HDR_ACCEPT_ENCODING] = "Accept-Encoding",
+        [HDR_IF_NONE_MATCH] = "If-None-Match",
+        [HDR_IF_MODIFIED_SINCE] = "If-Modified-Since",
+        [HDR_RANGE] = "Range",
+        [HDR_IF_RANGE] = "If-Range",
+        [HDR_TRANSFER_ENCODING] = "Transfer-Encoding",
+};
+
+// slots of the perfect hash below, -1 where no known header lands
+static const int KNOWN_HEADER_SLOTS[16] = {
+        HDR_IF_RANGE, HDR_IF_NONE_MATCH, -1, HDR_TRANSFER_ENCODING,
+        HDR_CONNECTION, HDR_IF_MODIFIED_SINCE, HDR_ACCEPT_ENCODING, HDR_CONTENT_TYPE,
+        -1, HDR_X_CSRF_TOKEN, HDR_COOKIE, -1,
+        -1, HDR_CONTENT_LENGTH, HDR_RANGE, HDR_HOST,
+};
+
+
+// collision-free for the known header names; the case bit is folded so the lookup is case-insensitive
+static int known_header(const char *name, size_t length) {
+    if (length < 2) {
+        return -1;
+    }
+    unsigned hash = (length + 9 * (name[0] | 0x20) + (name[length - 2] | 0x20)) & 15;
+    int header = KNOWN_HEADER_SLOTS[hash];
+    if (header == -1 || strlen(KNOWN_HEADERS[header]) != length ||
+        strncasecmp(name, KNOWN_HEADERS[header], length) != 0) {
+        return -1;
+    }
+    return header;
+}
+
+
+static unsigned other_header_hash(const char *name, size_t length) {
+    unsigned hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (unsigned char)(name[i] | 0x20)) * 16777619u;
+    }
+    return hash & (MAX_OTHER_HEADERS - 1);
+}
+
+
+static void index_other_header(HeaderIndex *index, const char *data, HeaderSpan name, HeaderSpan value) {
+    // past three quarters full, the rest of the headers nobody asks for by name are left out of the index
+    if (index->other_count >= MAX_OTHER_HEADERS * 3 / 4) {
+        return;
+    }
+    unsigned slot = other_header_hash(data + name.offset, name.length);
+    while (index->other_names[slot].offset != 0) {
+        if (index->other_names[slot].length == name.length &&
+            strncasecmp(data + index->other_names[slot].offset, data + name.offset, name.length) == 0) {
+            return;
+        }
+        slot = (slot + 1) & (MAX_OTHER_HEADERS - 1);
+    }
+    index->other_names[slot] = name;
+    index->other_values[slot] = value;
+    index->other_count++;
+}
+
+
+// the first occurrence of a header is the one that gets indexed
+static bool parse_header_line(MemchrRequestParser *parser, const char *data, const char *line, size_t length) {
+    const char *colon = memchr(line, ':', length);
+    if (!colon || colon == line || colon[-1] == ' ' || colon[-1] == '\t') {
+        return false;
+    }
+    const char *value = colon + 1;
+    const char *value_end = line + length;
+    while (value < value_end && (*value == ' ' || *value == '\t')) value++;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) value_end--;
+
+    HeaderSpan name_span = {line - data, colon - line};
+    HeaderSpan value_span = {value - data, value_end - value};
+    int header = known_header(line, name_span.length);
+    if (header == -1) {
+        index_other_header(&parser->headers, data, name_span, value_span);
+        return true;
+    }
+
+    bool repeated = parser->headers.known[header].offset != 0;
+    if (header == HDR_CONTENT_LENGTH) {
+        // differing lengths would let the request be framed two ways
+        size_t content_length;
+        if (!parse_content_length(value, value_end, &content_length) ||
+            (repeated && content_length != parser->content_length)) {
+            return false;
+        }
+        parser->content_length = content_length;
+    }
+    if (!repeated) {
+        parser->headers.known[header] = value_span;
+    }
+    return true;
+}
+
+
+// picks up where the previous call stopped; data always points at the start of the request
+RequestParsingStatus memchr_parser_feed(MemchrRequestParser *parser, const char *data, size_t length) {
+    while (parser->state == PARSER_REQUEST_LINE || parser->state == PARSER_HEADERS) {
+        const char *line_end = memchr(data + parser->scanned, '\n', length - parser->scanned);
+        if (!line_end) {
+            parser->scanned = length;
+            if (length > MAX_HEADER_SIZE) {
+                parser->state = PARSER_INVALID;
+            }
+            break;
+        }
+
+        size_t end = line_end - data;
+        parser->scanned = end + 1;
+        if (end == parser->line_start || data[end - 1] != '\r' || end >= MAX_HEADER_SIZE) {
+            parser->state = PARSER_INVALID;
+            break;
+        }
+        const char *line = data + parser->line_start;
+        size_t line_length = end - 1 - parser->line_start;
+        parser->line_start = parser->scanned;
+
+        if (parser->state == PARSER_REQUEST_LINE) {
+            if (line_length == 0) {
+                parser->state = PARSER_INVALID;
+                break;
+            }
+            parser->request_line_length = line_length;
+            parser->state = PARSER_HEADERS;
+        } else if (line_length == 0) {
+            parser->headers_length = parser->scanned;
+            parser->state = PARSER_BODY;
+        } else if (!parse_header_line(parser, data, line, line_length)) {
+            parser->state = PARSER_INVALID;
+        }
+    }
+
+    if (parser->state == PARSER_BODY && length - parser->headers_length >= parser->content_length) {
+        parser->state = PARSER_COMPLETE;
+    }
+
+    if (parser->state == PARSER_COMPLETE) {
+        return REQ_PARSE_SUCCESS;
+    } else if (parser->state == PARSER_INVALID) {
+        return REQ_PARSE_INVALID_FORMAT;
+    }
+    return REQ_PARSE_INCOMPLETE;
+}
+
+
+size_t memchr_parser_length(const MemchrRequestParser *parser) {
+    return parser->headers_length + parser->content_length;
+}
+
+
+// buffer holds the complete request the parser framed
+RequestParsingStatus memchr_parse_http_request(const char *buffer, const MemchrRequestParser *parser,
+                                               HttpRequest *request) {
+    if (parser->state != PARSER_COMPLETE) {
+        return REQ_PARSE_INVALID_FORMAT;
+    }
+    const char *line_end = buffer + parser->request_line_length;
+
+    const char *method_str = buffer;
+    const char *method_end = memchr(method_str, ' ', line_end - method_str);
+    if (!method_end) {
+        return REQ_PARSE_INVALID_FORMAT;
+    }
+    const char *target = method_end + 1;
+    while (target < line_end && *target == ' ') target++;
+    const char *target_end = memchr(target, ' ', line_end - target);
+    if (!target_end) {
+        return REQ_PARSE_INVALID_FORMAT;
+    }
+    const char *protocol = target_end + 1;
+    while (protocol < line_end && *protocol == ' ') protocol++;
+    const char *protocol_end = memchr(protocol, ' ', line_end - protocol);
+    if (!protocol_end) {
+        protocol_end = line_end;
+    }
+
+    const char *path_end = memchr(target, '?', target_end - target);
+    if (!path_end) {
+        path_end = target_end;
+    }
+    size_t method_length = method_end - method_str;
+    size_t path_length = path_end - target;
+    size_t protocol_length = protocol_end - protocol;
+    if (method_length >= 8 ||
+        path_length == 0 ||
+        path_length >= MAX_URL_PATH_LENGTH ||
+        target[0] != '/' ||
+        protocol_length >= 16 ||
+        protocol_length < 5 ||
+        strncmp(protocol, "HTTP/", 5) != 0) {
+        return REQ_PARSE_INVALID_FORMAT;
+    }
+
+    request->method = convert_method_str(method_str, method_length);
+    request->path = (Slice) {target, path_length};
+    request->protocol = (Slice) {protocol, protocol_length};
+    if (path_end < target_end) {
+        request->query_string = (Slice) {path_end + 1, target_end - path_end - 1};
+    }
+    request->body = (Slice) {buffer + parser->headers_length, parser->content_length};
+    request->start = buffer;
+    request->headers = &parser->headers;
+    return REQ_PARSE_SUCCESS;
+}
\ No newline at end of file
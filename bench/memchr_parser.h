@@ -0,0 +1,30 @@
+#ifndef HTTP_SERVER_MEMCHR_PARSER_H
+#define HTTP_SERVER_MEMCHR_PARSER_H
+
+#include "request.h"
+#include <stddef.h>
+
+
+// the incremental parser as it was before the tokenizer, finding every line and colon with memchr; it fills the
+// same HttpRequest, so headers are looked up through request.c
+typedef struct {
+    ParserState state;
+    size_t scanned;
+    size_t line_start;
+    size_t request_line_length;
+    size_t headers_length;
+    size_t content_length;
+    HeaderIndex headers;
+} MemchrRequestParser;
+
+void memchr_parser_reset(MemchrRequestParser *parser);
+
+RequestParsingStatus memchr_parser_feed(MemchrRequestParser *parser, const char *data, size_t length);
+
+size_t memchr_parser_length(const MemchrRequestParser *parser);
+
+RequestParsingStatus memchr_parse_http_request(const char *buffer, const MemchrRequestParser *parser,
+                                               HttpRequest *request);
+
+
+#endif
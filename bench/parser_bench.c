@@ -0,0 +1,216 @@
+#include "legacy_parser.h"
+#include "memchr_parser.h"
+#include "request.h"
+#include "tokenizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ITERATIONS 200000
+#define BUFFER_SIZE 8192
+
+
+// requests as browsers and curl actually send them to this server
+static const char *const CORPUS[] = {
+    "GET / HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 "
+    "Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,"
+    "application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "Cookie: session=3f9a1c0d8e7b6a5f4e3d2c1b0a9f8e7d6c5b4a3f2e1d0c9b8a7f6e5d4c3b2a1f\r\n"
+    "\r\n",
+
+    "GET /todos?page=2 HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Referer: http://localhost:8080/todos\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: session=3f9a1c0d8e7b6a5f4e3d2c1b0a9f8e7d6c5b4a3f2e1d0c9b8a7f6e5d4c3b2a1f\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Priority: u=0, i\r\n"
+    "\r\n",
+
+    "GET /static/css/styles.css HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Accept-Language: en-GB,en;q=0.9\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko) "
+    "Version/17.4.1 Safari/605.1.15\r\n"
+    "Referer: http://localhost:8080/\r\n"
+    "Connection: keep-alive\r\n"
+    "Sec-Fetch-Dest: style\r\n"
+    "\r\n",
+
+    "POST /todos HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: keep-alive\r\n"
+    "Content-Length: 44\r\n"
+    "Cache-Control: max-age=0\r\n"
+    "Origin: http://localhost:8080\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "X-CSRF-Token: 8c1d4e2f9a7b3c6d5e0f1a2b3c4d5e6f\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 "
+    "Safari/537.36\r\n"
+    "Accept: */*\r\n"
+    "Referer: http://localhost:8080/todos\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "Cookie: theme=dark; session=3f9a1c0d8e7b6a5f4e3d2c1b0a9f8e7d6c5b4a3f2e1d0c9b8a7f6e5d4c3b2a1f\r\n"
+    "\r\n"
+    "title=Buy+groceries&description=milk%2C+eggs",
+
+    "GET /login HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+};
+
+#define CORPUS_SIZE (sizeof(CORPUS) / sizeof(CORPUS[0]))
+
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+// frames, parses and looks up the session cookie the way the server did before the incremental parser
+static double run_legacy(size_t *lengths) {
+    char buffer[BUFFER_SIZE];
+    size_t checksum = 0;
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        size_t n = i % CORPUS_SIZE;
+        memcpy(buffer, CORPUS[n], lengths[n] + 1);
+        if (legacy_frame_request(buffer, lengths[n]) != lengths[n]) {
+            fprintf(stderr, "Legacy framing failed on request %zu\n", n);
+            exit(1);
+        }
+        LegacyHttpRequest request;
+        memset(&request, 0, sizeof(request));
+        if (!legacy_parse_http_request(buffer, &request)) {
+            fprintf(stderr, "Legacy parsing failed on request %zu\n", n);
+            exit(1);
+        }
+        const char *cookie = request.headers ? strstr(request.headers, "Cookie: ") : NULL;
+        checksum += strlen(request.path) + (cookie != NULL);
+        legacy_free_http_request(&request);
+    }
+    double elapsed = now_ns() - start;
+    if (checksum == 0) puts("");
+    return elapsed / ITERATIONS;
+}
+
+
+// the same work through the parser the tokenizer replaced, which is what it has to beat
+static double run_memchr(size_t *lengths) {
+    char buffer[BUFFER_SIZE];
+    size_t checksum = 0;
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        size_t n = i % CORPUS_SIZE;
+        memcpy(buffer, CORPUS[n], lengths[n] + 1);
+        MemchrRequestParser parser;
+        memchr_parser_reset(&parser);
+        if (memchr_parser_feed(&parser, buffer, lengths[n]) != REQ_PARSE_SUCCESS ||
+            memchr_parser_length(&parser) != lengths[n]) {
+            fprintf(stderr, "memchr framing failed on request %zu\n", n);
+            exit(1);
+        }
+        HttpRequest request;
+        memset(&request, 0, sizeof(request));
+        if (memchr_parse_http_request(buffer, &parser, &request) != REQ_PARSE_SUCCESS) {
+            fprintf(stderr, "memchr parsing failed on request %zu\n", n);
+            exit(1);
+        }
+        Slice cookie = request_header(&request, HDR_COOKIE);
+        checksum += request.path.len + (cookie.ptr != NULL);
+    }
+    double elapsed = now_ns() - start;
+    if (checksum == 0) puts("");
+    return elapsed / ITERATIONS;
+}
+
+
+static double run_current(size_t *lengths) {
+    char buffer[BUFFER_SIZE];
+    size_t checksum = 0;
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        size_t n = i % CORPUS_SIZE;
+        memcpy(buffer, CORPUS[n], lengths[n] + 1);
+        RequestParser parser;
+        request_parser_reset(&parser);
+        if (request_parser_feed(&parser, buffer, lengths[n]) != REQ_PARSE_SUCCESS ||
+            request_parser_length(&parser) != lengths[n]) {
+            fprintf(stderr, "Framing failed on request %zu\n", n);
+            exit(1);
+        }
+        HttpRequest request;
+        memset(&request, 0, sizeof(request));
+        if (parse_http_request(buffer, &parser, &request) != REQ_PARSE_SUCCESS) {
+            fprintf(stderr, "Parsing failed on request %zu\n", n);
+            exit(1);
+        }
+        Slice cookie = request_header(&request, HDR_COOKIE);
+        checksum += request.path.len + (cookie.ptr != NULL);
+    }
+    double elapsed = now_ns() - start;
+    if (checksum == 0) puts("");
+    return elapsed / ITERATIONS;
+}
+
+
+int main() {
+    size_t lengths[CORPUS_SIZE];
+    size_t total = 0;
+    for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+        lengths[i] = strlen(CORPUS[i]);
+        total += lengths[i];
+    }
+    printf("%zu requests, %zu bytes on average, %d iterations\n\n", CORPUS_SIZE, total / CORPUS_SIZE, ITERATIONS);
+
+    // one untimed round each, so page faults and cold caches don't count against the first contender
+    run_legacy(lengths);
+    printf("%-24s %8.1f ns/request\n", "legacy strtok parser", run_legacy(lengths));
+    run_memchr(lengths);
+    printf("%-24s %8.1f ns/request\n", "memchr parser", run_memchr(lengths));
+
+    const TokenizerLevel levels[] = {TOKENIZER_SCALAR, TOKENIZER_SSE42, TOKENIZER_AVX2};
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+        if (!tokenizer_use(levels[i])) {
+            printf("%-24s %11s\n", tokenizer_level_name(levels[i]), "unsupported");
+            continue;
+        }
+        run_current(lengths);
+        char label[32];
+        snprintf(label, sizeof(label), "tokenizer (%s)", tokenizer_level_name(levels[i]));
+        printf("%-24s %8.1f ns/request\n", label, run_current(lengths));
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+-- plans and timings of the todo list queries for a user with 100k todos; run against a scratch database
+-- that init.sql has been applied to:  psql -d scratch -f bench/todo_pagination.sql
+\timing on
+
+BEGIN;
+
+INSERT INTO users (email, password, is_verified)
+VALUES ('pagination-bench@example.com', 'x', TRUE);
+
+INSERT INTO todos (user_id, summary, task)
+SELECT u.id, 'summary ' || n, repeat('task ', 20)
+FROM users u, generate_series(1, 100000) n
+WHERE u.email = 'pagination-bench@example.com';
+
+-- a few other users, so the index has to narrow down by user_id
+INSERT INTO todos (user_id, summary, task)
+SELECT u.id, 'other ' || n, 'other'
+FROM users u, generate_series(1, 1000) n
+WHERE u.email <> 'pagination-bench@example.com';
+
+ANALYZE todos;
+
+SELECT id AS bench_user FROM users WHERE email = 'pagination-bench@example.com' \gset
+
+-- what the old query did: the -id expression can't use an index, so every row of the user is sorted
+EXPLAIN (ANALYZE, BUFFERS)
+SELECT id, creation_time, summary, task, due_time FROM todos
+WHERE user_id = :bench_user ORDER BY -id LIMIT 8 OFFSET 99000;
+
+-- page numbers: the index gives the order, but the offset still reads and throws away 99000 rows
+EXPLAIN (ANALYZE, BUFFERS)
+SELECT id, creation_time, summary, task, due_time FROM todos
+WHERE user_id = :bench_user ORDER BY id DESC LIMIT 8 OFFSET 99000;
+
+-- cursor at the same depth: 8 rows read off the index
+SELECT id AS deep_cursor FROM todos WHERE user_id = :bench_user ORDER BY id DESC LIMIT 1 OFFSET 98999 \gset
+
+EXPLAIN (ANALYZE, BUFFERS)
+SELECT id, creation_time, summary, task, due_time FROM todos
+WHERE user_id = :bench_user AND id < :deep_cursor ORDER BY id DESC LIMIT 8;
+
+EXPLAIN (ANALYZE, BUFFERS)
+SELECT id, creation_time, summary, task, due_time FROM todos
+WHERE user_id = :bench_user AND id > :deep_cursor ORDER BY id ASC LIMIT 8;
+
+-- what the server sends for a cursor page: the page and the user's total in one statement, the user looked up
+-- by session token so it can share a round trip with the session check; the total is the count the todos
+-- trigger keeps on the user's row, not a scan of their todos
+INSERT INTO sessions (user_id, token, csrf_token, expires_at)
+VALUES (:bench_user, 'pagination-bench', 'pagination-bench', NOW() + INTERVAL '1 day');
+
+EXPLAIN (ANALYZE, BUFFERS)
+WITH owner AS (SELECT user_id FROM sessions WHERE token = 'pagination-bench' AND expires_at > NOW()),
+total AS (SELECT COALESCE((SELECT todo_count FROM users WHERE id = (SELECT user_id FROM owner)), 0) AS total)
+SELECT page.id, page.creation_time, page.summary, page.task, page.due_time, total.total FROM total
+LEFT JOIN LATERAL (SELECT id, creation_time, summary, task, due_time FROM todos
+                   WHERE user_id = (SELECT user_id FROM owner) AND id < :deep_cursor ORDER BY id DESC LIMIT 8) page
+ON TRUE ORDER BY page.id DESC;
+
+ROLLBACK;
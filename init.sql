@@ -5,7 +5,8 @@ CREATE TABLE IF NOT EXISTS users
     password           VARCHAR(128)          NOT NULL,
     is_verified        BOOLEAN DEFAULT FALSE NOT NULL,
     verification_token CHAR(64) UNIQUE,
-    token_expires_at   TIMESTAMP
+    token_expires_at   TIMESTAMP,
+    todo_count         INTEGER DEFAULT 0     NOT NULL
 );
 
 CREATE TABLE IF NOT EXISTS verification_results
@@ -54,6 +55,40 @@ CREATE TABLE IF NOT EXISTS todos
         ON DELETE CASCADE
 );
 
+-- the todo list is read newest first per user, a page at a time
+CREATE INDEX IF NOT EXISTS todos_user_id_id_idx ON todos (user_id, id DESC);
+
+-- databases created before todo_count existed get the column, counted once from the todos they already have; the
+-- statements preparing the todo pages fail without it
+DO $$
+BEGIN
+    IF NOT EXISTS (SELECT 1 FROM information_schema.columns
+                   WHERE table_schema = current_schema() AND table_name = 'users' AND column_name = 'todo_count') THEN
+        ALTER TABLE users ADD COLUMN IF NOT EXISTS todo_count INTEGER NOT NULL DEFAULT 0;
+        UPDATE users SET todo_count = (SELECT COUNT(*) FROM todos WHERE user_id = users.id);
+    END IF;
+END;
+$$;
+
+
+-- every page of the todo list shows how many todos there are, which would otherwise mean counting them all each time
+CREATE OR REPLACE FUNCTION count_todos()
+RETURNS TRIGGER AS $$
+BEGIN
+    IF TG_OP = 'INSERT' THEN
+        UPDATE users SET todo_count = todo_count + 1 WHERE id = NEW.user_id;
+    ELSE
+        UPDATE users SET todo_count = todo_count - 1 WHERE id = OLD.user_id;
+    END IF;
+    RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+DROP TRIGGER IF EXISTS todos_count ON todos;
+CREATE TRIGGER todos_count
+    AFTER INSERT OR DELETE ON todos
+    FOR EACH ROW EXECUTE FUNCTION count_todos();
+
 
 CREATE OR REPLACE FUNCTION cleanup_expired_user_tokens()
 RETURNS INTEGER AS $$
@@ -1,5 +1,6 @@
 #include "email_change_requests.h"
 #include "util/generate_token.h"
+#include "util/statements.h"
 #include "users.h"
 #include <string.h>
 #include <stdlib.h>
@@ -22,12 +23,9 @@ static bool rollback_transaction(PGconn *conn, PGresult *res) {
 
 
 static bool check_email_taken(PGconn *conn, const char *email, bool *taken) {
-    const char *query = "SELECT EXISTS (SELECT 1 FROM users WHERE email = $1 AND is_verified = true LIMIT 1)";
     const char *params[1] = {email};
-    int param_lengths[1] = {strlen(email)};
-    int param_formats[1] = {0};
 
-    PGresult *res = PQexecParams(conn, query, 1, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_VERIFIED_EMAIL_TAKEN, params);
 
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "Checking email existence failed: %s", PQerrorMessage(conn));
@@ -63,13 +61,9 @@ QueryResult db_create_email_change_request(PGconn *conn, int user_id, const char
     char user_id_str[10];
     snprintf(user_id_str, sizeof(user_id_str), "%d", user_id);
 
-    const char *query = "INSERT INTO email_change_requests(user_id, new_email, verification_token, token_expires_at) "
-                        "VALUES ($1, $2, $3, to_timestamp($4))";
     const char *params[4] = {user_id_str, email, verification_token, expiry_str};
-    int param_lengths[4] = {strlen(user_id_str), strlen(email), strlen(verification_token), strlen(expiry_str)};
-    int param_formats[4] = {0, 0, 0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 4, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_CREATE_EMAIL_CHANGE, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         if (strcmp(PQresultErrorField(res, PG_DIAG_SQLSTATE), "23505") == 0) {
@@ -91,14 +85,9 @@ QueryResult db_create_email_change_request(PGconn *conn, int user_id, const char
 
 
 QueryResult db_get_new_verification_token(PGconn *conn, const char *email, int *user_id, char *token) {
-    const char *query = "SELECT user_id, verification_token FROM email_change_requests "
-                        "WHERE new_email = $1 AND token_expires_at > NOW() "
-                        "ORDER BY id DESC LIMIT 1";
     const char *params[1] = {email};
-    int param_lengths[1] = {strlen(email)};
-    int param_formats[1] = {0};
 
-    PGresult *res = PQexecParams(conn, query, 1, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_GET_EMAIL_CHANGE, params);
 
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "Verification token retrieval failed: %s", PQerrorMessage(conn));
@@ -118,12 +107,9 @@ QueryResult db_get_new_verification_token(PGconn *conn, const char *email, int *
 
 
 static bool delete_email_change_request(PGconn *conn, const char *token) {
-    const char *query = "DELETE FROM email_change_requests WHERE verification_token = $1";
     const char *params[1] = {token};
-    int param_lengths[1] = {strlen(token)};
-    int param_formats[1] = {0};
 
-    PGresult *res = PQexecParams(conn, query, 1, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_DELETE_EMAIL_CHANGE, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "Email change request deletion failed: %s", PQerrorMessage(conn));
@@ -1,5 +1,5 @@
 #include "sessions.h"
-#include "./util/generate_token.h"
+#include "./util/statements.h"
 #include <time.h>
 #include <string.h>
 #include <stdlib.h>
@@ -7,11 +7,8 @@
 #define SESSION_EXPIRY_DAYS 30
 
 
-bool db_create_session(PGconn *conn, int user_id, char *session_token, char *csrf_token) {
-    if (!generate_token(session_token) || !generate_token(csrf_token)) {
-        return false;
-    }
-
+// the tokens are generated by the caller before the batch is started, a batch can't take back what it has queued
+bool db_queue_create_session(QueryBatch *batch, int user_id, const char *session_token, const char *csrf_token) {
     time_t now = time(NULL);
     struct tm *tm_info = gmtime(&now);
     tm_info->tm_mday += SESSION_EXPIRY_DAYS;
@@ -22,29 +19,13 @@ bool db_create_session(PGconn *conn, int user_id, char *session_token, char *csr
     snprintf(user_id_str, sizeof(user_id_str), "%d", user_id);
     snprintf(expires_str, sizeof(expires_str), "%ld", expires);
 
-    const char *query = "INSERT INTO sessions (user_id, token, csrf_token, expires_at) VALUES ($1, $2, $3, to_timestamp($4))";
     const char *params[4] = {user_id_str, session_token, csrf_token, expires_str};
-    int param_lengths[4] = {strlen(user_id_str), strlen(session_token), strlen(csrf_token), strlen(expires_str)};
-    int param_formats[4] = {0, 0, 0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 4, NULL, params, param_lengths, param_formats, 0);
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        fprintf(stderr, "Session creation failed: %s", PQerrorMessage(conn));
-        PQclear(res);
-        return false;
-    }
-    PQclear(res);
-    return true;
+    return batch_queue(batch, STMT_CREATE_SESSION, params);
 }
 
 
-QueryResult db_validate_and_retrieve_session_info(PGconn *conn, const char *token, char *csrf_token, int *user_id) {
-    const char *query = "SELECT user_id, csrf_token FROM sessions WHERE token = $1 AND expires_at > NOW()";
-    const char *params[1] = {token};
-    int param_lengths[1] = {strlen(token)};
-    int param_formats[1] = {0};
-
-    PGresult *res = PQexecParams(conn, query, 1, NULL, params, param_lengths, param_formats, 0);
+static QueryResult read_session_info(PGconn *conn, PGresult *res, char *csrf_token, int *user_id) {
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "Session information retrieval failed: %s", PQerrorMessage(conn));
         PQclear(res);
@@ -66,13 +47,30 @@ QueryResult db_validate_and_retrieve_session_info(PGconn *conn, const char *toke
 }
 
 
+QueryResult db_validate_and_retrieve_session_info(PGconn *conn, const char *token, char *csrf_token, int *user_id) {
+    const char *params[1] = {token};
+
+    PGresult *res = exec_statement(conn, STMT_GET_SESSION, params);
+    return read_session_info(conn, res, csrf_token, user_id);
+}
+
+
+bool db_queue_session_info(QueryBatch *batch, const char *token) {
+    const char *params[1] = {token};
+    return batch_queue(batch, STMT_GET_SESSION, params);
+}
+
+
+QueryResult db_read_session_info(QueryBatch *batch, char *csrf_token, int *user_id) {
+    PGresult *res = batch_next_result(batch);
+    return read_session_info(batch->conn, res, csrf_token, user_id);
+}
+
+
 bool db_delete_session(PGconn *conn, const char *token) {
-    const char *query = "DELETE FROM sessions WHERE token = $1";
     const char *params[1] = {token};
-    int param_lengths[1] = {strlen(token)};
-    int param_formats[1] = {0};
 
-    PGresult *res = PQexecParams(conn, query, 1, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_DELETE_SESSION, params);
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "Session deletion failed: %s", PQerrorMessage(conn));
         PQclear(res);
@@ -2,13 +2,18 @@
 #define HTTP_SERVER_SESSIONS_H
 
 #include "util/query_result.h"
+#include "util/batch.h"
 #include <libpq-fe.h>
 
 
-bool db_create_session(PGconn *conn, int user_id, char *token, char *csrf_token);
+bool db_queue_create_session(QueryBatch *batch, int user_id, const char *token, const char *csrf_token);
 
 QueryResult db_validate_and_retrieve_session_info(PGconn *conn, const char *token, char *csrf_token, int *user_id);
 
+bool db_queue_session_info(QueryBatch *batch, const char *token);
+
+QueryResult db_read_session_info(QueryBatch *batch, char *csrf_token, int *user_id);
+
 bool db_delete_session(PGconn *conn, const char *token);
 
 
@@ -1,46 +1,26 @@
 #include "todos.h"
+#include "util/statements.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 
-int db_get_total_todos_count(PGconn *conn, int user_id) {
-    char query[256];
-    snprintf(query, sizeof(query), "SELECT COUNT(*) FROM todos WHERE user_id = %d", user_id);
+// a page past the end of the todos still has its row, with a NULL id
+Todo *db_read_todos(QueryBatch *batch, int *count, int *total_count) {
+    PGresult *res = batch_next_result(batch);
 
-    PGresult *res = PQexec(conn, query);
-
-    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-        fprintf(stderr, "TODOs counting failed: %s", PQerrorMessage(conn));
-        PQclear(res);
-        return -1;
-    }
-    if (PQntuples(res) == 0) {
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
+        fprintf(stderr, "TODO retrieval failed: %s", PQerrorMessage(batch->conn));
         PQclear(res);
-        return -1;
+        return NULL;
     }
-    int count = atoi(PQgetvalue(res, 0, 0));
-    PQclear(res);
-    return count;
-}
-
-
-Todo *db_get_all_todos(PGconn *conn, int user_id, int *count, int page, int page_size) {
-    char query[128];
-    sprintf(query, "SELECT id, creation_time, summary, task, due_time FROM todos "
-                   "WHERE user_id = %d "
-                   "ORDER BY -id LIMIT %d OFFSET %d",
-                   user_id, page_size, (page - 1) * page_size);
-
-    PGresult *res = PQexec(conn, query);
-
-    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-        fprintf(stderr, "TODO retrieval failed: %s", PQerrorMessage(conn));
+    *total_count = atoi(PQgetvalue(res, 0, 5));
+    *count = PQgetisnull(res, 0, 0) ? 0 : PQntuples(res);
+    Todo *todos = malloc((*count > 0 ? *count : 1) * sizeof(Todo));
+    if (!todos) {
         PQclear(res);
         return NULL;
     }
-    *count = PQntuples(res);
-    Todo *todos = malloc(*count * sizeof(Todo));
     for (int i = 0; i < *count; ++i) {
         todos[i].id = atoi(PQgetvalue(res, i, 0));
         todos[i].creation_time = strdup(PQgetvalue(res, i, 1));
@@ -53,6 +33,39 @@ Todo *db_get_all_todos(PGconn *conn, int user_id, int *count, int page, int page
 }
 
 
+// page numbers are kept for old links; the offset still makes deep pages read every row before them
+bool db_queue_todos(QueryBatch *batch, const char *session_token, int page, int page_size) {
+    char limit_str[12], offset_str[12];
+    snprintf(limit_str, sizeof(limit_str), "%d", page_size);
+    snprintf(offset_str, sizeof(offset_str), "%d", (page - 1) * page_size);
+
+    const char *params[3] = {session_token, limit_str, offset_str};
+    return batch_queue(batch, STMT_TODO_PAGE, params);
+}
+
+
+// the page_size todos older than after_id, read straight off the (user_id, id DESC) index
+bool db_queue_todos_after(QueryBatch *batch, const char *session_token, int after_id, int page_size) {
+    char after_str[12], limit_str[12];
+    snprintf(after_str, sizeof(after_str), "%d", after_id);
+    snprintf(limit_str, sizeof(limit_str), "%d", page_size);
+
+    const char *params[3] = {session_token, after_str, limit_str};
+    return batch_queue(batch, STMT_TODO_PAGE_AFTER, params);
+}
+
+
+// the page_size todos newer than before_id; the index is walked upwards, the rows still come back newest first
+bool db_queue_todos_before(QueryBatch *batch, const char *session_token, int before_id, int page_size) {
+    char before_str[12], limit_str[12];
+    snprintf(before_str, sizeof(before_str), "%d", before_id);
+    snprintf(limit_str, sizeof(limit_str), "%d", page_size);
+
+    const char *params[3] = {session_token, before_str, limit_str};
+    return batch_queue(batch, STMT_TODO_PAGE_BEFORE, params);
+}
+
+
 void free_todos(Todo *todos, int count) {
     for (int i = 0; i < count; ++i) {
         free(todos[i].creation_time);
@@ -68,12 +81,9 @@ static bool db_create_todo_no_duetime(PGconn *conn, Todo *todo) {
     char user_id_str[12];
     snprintf(user_id_str, sizeof(user_id_str), "%d", todo->user_id);
 
-    const char *query = "INSERT INTO todos (user_id, summary, task) VALUES ($1, $2, $3)";
     const char *params[3] = {user_id_str, todo->summary, todo->task};
-    int param_lengths[3] = {strlen(user_id_str), strlen(todo->summary), strlen(todo->task)};
-    int param_formats[3] = {0, 0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 3, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_CREATE_TODO, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "TODO creation failed: %s", PQerrorMessage(conn));
@@ -91,12 +101,9 @@ bool db_create_todo(PGconn *conn, Todo *todo) {
     char user_id_str[12];
     snprintf(user_id_str, sizeof(user_id_str), "%d", todo->user_id);
 
-    const char *query = "INSERT INTO todos (user_id, summary, task, due_time) VALUES ($1, $2, $3, $4)";
     const char *params[4] = {user_id_str, todo->summary, todo->task, todo->due_time};
-    int param_lengths[4] = {strlen(user_id_str), strlen(todo->summary), strlen(todo->task), strlen(todo->due_time)};
-    int param_formats[4] = {0, 0, 0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 4, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_CREATE_TODO_DUE, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "TODO creation failed: %s", PQerrorMessage(conn));
@@ -112,13 +119,9 @@ static QueryResult db_update_todo_no_duetime(PGconn *conn, Todo *todo) {
     snprintf(id_str, sizeof(id_str), "%d", todo->id);
     snprintf(user_id_str, sizeof(user_id_str), "%d", todo->user_id);
 
-    const char *query = "UPDATE todos SET summary = $1, task = $2 WHERE id = $3 AND user_id = $4";
     const char *params[4] = {todo->summary, todo->task, id_str, user_id_str};
-    int param_lengths[4] = {strlen(todo->summary), strlen(todo->task),
-                            strlen(id_str), strlen(user_id_str)};
-    int param_formats[4] = {0, 0, 0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 4, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_UPDATE_TODO, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "TODO update failed: %s", PQerrorMessage(conn));
@@ -141,13 +144,9 @@ QueryResult db_update_todo(PGconn *conn, Todo *todo) {
     snprintf(id_str, sizeof(id_str), "%d", todo->id);
     snprintf(user_id_str, sizeof(user_id_str), "%d", todo->user_id);
 
-    const char *query = "UPDATE todos SET summary = $1, task = $2, due_time = $3 WHERE id = $4 AND user_id = $5";
     const char *params[5] = {todo->summary, todo->task, todo->due_time, id_str, user_id_str};
-    int param_lengths[5] = {strlen(todo->summary), strlen(todo->task), strlen(todo->due_time),
-                            strlen(id_str), strlen(user_id_str)};
-    int param_formats[5] = {0, 0, 0, 0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 5, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_UPDATE_TODO_DUE, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "TODO update failed: %s", PQerrorMessage(conn));
@@ -163,10 +162,13 @@ QueryResult db_update_todo(PGconn *conn, Todo *todo) {
 
 
 QueryResult db_delete_todo(PGconn *conn, int id, int user_id) {
-    char query[65];
-    sprintf(query, "DELETE FROM todos WHERE id = %d AND user_id = %d", id, user_id);
+    char id_str[12], user_id_str[12];
+    snprintf(id_str, sizeof(id_str), "%d", id);
+    snprintf(user_id_str, sizeof(user_id_str), "%d", user_id);
+
+    const char *params[2] = {id_str, user_id_str};
 
-    PGresult *res = PQexec(conn, query);
+    PGresult *res = exec_statement(conn, STMT_DELETE_TODO, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "TODO deletion failed: %s", PQerrorMessage(conn));
@@ -2,6 +2,7 @@
 #define HTTP_SERVER_TODOS_H
 
 #include "util/query_result.h"
+#include "util/batch.h"
 #include <libpq-fe.h>
 
 #define DB_SUMMARY_LEN 128
@@ -17,9 +18,13 @@ typedef struct {
     char *due_time;
 } Todo;
 
-int db_get_total_todos_count(PGconn *conn, int user_id);
+bool db_queue_todos(QueryBatch *batch, const char *session_token, int page, int page_size);
 
-Todo *db_get_all_todos(PGconn *conn, int user_id, int *count, int page, int page_size);
+bool db_queue_todos_after(QueryBatch *batch, const char *session_token, int after_id, int page_size);
+
+bool db_queue_todos_before(QueryBatch *batch, const char *session_token, int before_id, int page_size);
+
+Todo *db_read_todos(QueryBatch *batch, int *count, int *total_count);
 
 bool db_create_todo(PGconn *conn, Todo *todo);
 
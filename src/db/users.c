@@ -1,6 +1,7 @@
 #include "users.h"
 #include "sessions.h"
 #include "util/generate_token.h"
+#include "util/statements.h"
 #include <string.h>
 #include <libpq-fe.h>
 #include <argon2.h>
@@ -14,12 +15,9 @@
 
 
 bool db_check_reset_password_verification_token(PGconn *conn, const char *token, bool *exists) {
-    const char *query = "SELECT EXISTS (SELECT 1 FROM users WHERE is_verified = true AND verification_token = $1 LIMIT 1)";
     const char *params[1] = {token};
-    int param_lengths[1] = {strlen(token)};
-    int param_formats[1] = {0};
 
-    PGresult *res = PQexecParams(conn, query, 1, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_RESET_TOKEN_EXISTS, params);
 
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "Token verification checking failed: %s", PQerrorMessage(conn));
@@ -38,12 +36,9 @@ bool db_check_reset_password_verification_token(PGconn *conn, const char *token,
 
 
 QueryResult db_get_verification_token(PGconn *conn, const char *email, char *token, bool *is_verified) {
-    const char *query = "SELECT is_verified, verification_token FROM users WHERE email = $1 AND token_expires_at > NOW()";
     const char *params[1] = {email};
-    int param_lengths[1] = {strlen(email)};
-    int param_formats[1] = {0};
 
-    PGresult *res = PQexecParams(conn, query, 1, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_GET_VERIFICATION_TOKEN, params);
 
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "Verification token retrieval failed: %s", PQerrorMessage(conn));
@@ -74,12 +69,9 @@ QueryResult db_set_verification_token(PGconn *conn, const char *email, char *tok
     char expiry_str[21];
     snprintf(expiry_str, sizeof(expiry_str), "%ld", expiry_time);
 
-    const char *query = "UPDATE users SET verification_token = $1, token_expires_at = to_timestamp($2) WHERE email = $3";
     const char *params[3] = {verification_token, expiry_str, email};
-    int param_lengths[3] = {strlen(verification_token), strlen(expiry_str), strlen(email)};
-    int param_formats[3] = {0, 0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 3, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_SET_VERIFICATION_TOKEN, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "Verification info update failed: %s", PQerrorMessage(conn));
@@ -97,12 +89,9 @@ QueryResult db_set_verification_token(PGconn *conn, const char *email, char *tok
 
 
 bool db_verify_email(PGconn *conn, const char *email) {
-    const char *query = "UPDATE users SET is_verified = true, verification_token = NULL, token_expires_at = NULL WHERE email = $1";
     const char *params[1] = {email};
-    int param_lengths[1] = {strlen(email)};
-    int param_formats[1] = {0};
 
-    PGresult *res = PQexecParams(conn, query, 1, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_VERIFY_EMAIL, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "Email verification failed: %s", PQerrorMessage(conn));
@@ -119,10 +108,12 @@ bool db_verify_email(PGconn *conn, const char *email) {
 
 
 bool db_get_user_email(PGconn *conn, int id, char *email) {
-    char query[64];
-    sprintf(query, "SELECT email FROM users WHERE id = %d", id);
+    char id_str[12];
+    snprintf(id_str, sizeof(id_str), "%d", id);
+
+    const char *params[1] = {id_str};
 
-    PGresult *res = PQexec(conn, query);
+    PGresult *res = exec_statement(conn, STMT_GET_USER_EMAIL, params);
 
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "User email retrieval failed: %s", PQerrorMessage(conn));
@@ -142,12 +133,9 @@ bool db_get_user_email(PGconn *conn, int id, char *email) {
 
 
 static bool check_user_verified(PGconn *conn, const char *email, bool *is_verified) {
-    const char *query = "SELECT is_verified FROM users WHERE email = $1";
     const char *params[1] = {email};
-    int param_lengths[1] = {strlen(email)};
-    int param_formats[1] = {0};
 
-    PGresult *res = PQexecParams(conn, query, 1, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_GET_USER_VERIFIED, params);
 
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "User verification info retrieval failed: %s", PQerrorMessage(conn));
@@ -165,12 +153,9 @@ static bool check_user_verified(PGconn *conn, const char *email, bool *is_verifi
 
 
 static bool update_unverified_user(PGconn *conn, const char *email, const char *password, const char *token, const char *expiry) {
-    const char *query = "UPDATE users SET password = $1, verification_token = $2, token_expires_at = to_timestamp($3) WHERE email = $4";
     const char *params[4] = {password, token, expiry, email};
-    int param_lengths[4] = {strlen(password), strlen(token), strlen(expiry), strlen(email)};
-    int param_formats[4] = {0, 0, 0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 4, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_UPDATE_UNVERIFIED_USER, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "Unverified user update failed: %s", PQerrorMessage(conn));
@@ -217,12 +202,9 @@ QueryResult db_signup_user(PGconn *conn, User *user, char *token) {
     char expiry_str[21];
     snprintf(expiry_str, sizeof(expiry_str), "%ld", expiry_time);
 
-    const char *query = "INSERT INTO users (email, password, verification_token, token_expires_at) VALUES ($1, $2, $3, to_timestamp($4))";
     const char *params[4] = {user->email, encoded, verification_token, expiry_str};
-    int param_lengths[4] = {strlen(user->email), strlen(encoded), strlen(verification_token), strlen(expiry_str)};
-    int param_formats[4] = {0, 0, 0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 4, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_SIGNUP_USER, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         if (strcmp(PQresultErrorField(res, PG_DIAG_SQLSTATE), "23505") == 0) {
@@ -251,66 +233,55 @@ QueryResult db_signup_user(PGconn *conn, User *user, char *token) {
 }
 
 
-// for cleaning up old sessions
-static bool delete_user_sessions(PGconn *conn, int user_id) {
-    char query[64];
-    sprintf(query, "DELETE FROM sessions WHERE user_id = %d", user_id);
+// the old sessions are deleted and the new one created in one round trip, as one transaction
+static QueryResult replace_user_sessions(PGconn *conn, int user_id, char *session_token) {
+    char csrf_token[SESSION_TOKEN_LENGTH * 2 + 1];
+    if (!generate_token(session_token) || !generate_token(csrf_token)) {
+        return QRESULT_INTERNAL_ERROR;
+    }
 
-    PGresult *res = PQexec(conn, query);
+    char user_id_str[12];
+    snprintf(user_id_str, sizeof(user_id_str), "%d", user_id);
 
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        fprintf(stderr, "User session deletion failed: %s", PQerrorMessage(conn));
-        PQclear(res);
-        return false;
+    const char *params[1] = {user_id_str};
+
+    QueryBatch batch;
+    if (!batch_begin(&batch, conn)) {
+        return QRESULT_INTERNAL_ERROR;
     }
-    if (PQcmdTuples(res) == 0) {
-        PQclear(res);
-        return false;
+    if (!batch_queue(&batch, STMT_DELETE_USER_SESSIONS, params) ||
+        !db_queue_create_session(&batch, user_id, session_token, csrf_token) || !batch_send(&batch)) {
+        batch_end(&batch);
+        return QRESULT_INTERNAL_ERROR;
     }
-    PQclear(res);
-    return true;
-}
-
 
-static bool rollback_transaction(PGconn *conn, PGresult *res) {
-    res = PQexec(conn, "ROLLBACK");
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        fprintf(stderr, "Failed to rollback transaction: %s", PQerrorMessage(conn));
-        PQclear(res);
-        return false;
+    PGresult *deleted = batch_next_result(&batch);
+    PGresult *created = batch_next_result(&batch);
+    QueryResult qres = QRESULT_OK;
+    if (PQresultStatus(deleted) != PGRES_COMMAND_OK || PQresultStatus(created) != PGRES_COMMAND_OK) {
+        fprintf(stderr, "Session creation failed: %s", PQerrorMessage(conn));
+        qres = QRESULT_INTERNAL_ERROR;
     }
-    PQclear(res);
-    return true;
+    PQclear(deleted);
+    PQclear(created);
+    batch_end(&batch);
+    return qres;
 }
 
 
+// the credentials are read outside of a transaction, nothing is written until the password has been checked
 QueryResult db_login_user(PGconn *conn, User *user, char *session_token) {
-    PGresult *res = PQexec(conn, "BEGIN");
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        fprintf(stderr, "Failed to begin transaction: %s", PQerrorMessage(conn));
-        PQclear(res);
-        return QRESULT_INTERNAL_ERROR;
-    }
-    PQclear(res);
-
-    const char *query = "SELECT id, password, is_verified FROM users WHERE email = $1";
     const char *params[1] = {user->email};
-    int param_lengths[1] = {strlen(user->email)};
-    int param_formats[1] = {0};
 
-    res = PQexecParams(conn, query, 1, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_GET_LOGIN, params);
 
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "User login failed: %s", PQerrorMessage(conn));
         PQclear(res);
-        rollback_transaction(conn, res);
         return QRESULT_INTERNAL_ERROR;
     }
     if (PQntuples(res) == 0) {
         PQclear(res);
-        if (!rollback_transaction(conn, res)) {
-            return QRESULT_INTERNAL_ERROR;
-        }
         return QRESULT_NONE_AFFECTED;
     }
 
@@ -321,39 +292,16 @@ QueryResult db_login_user(PGconn *conn, User *user, char *session_token) {
     user->is_verified = is_verified;
     if (!is_verified) {
         PQclear(res);
-        if (!rollback_transaction(conn, res)) {
-            return QRESULT_INTERNAL_ERROR;
-        }
         return QRESULT_USER_ERROR;
     }
 
-    char csrf_token[SESSION_TOKEN_LENGTH * 2 + 1];
     int verify_result = argon2id_verify(stored_hash, user->password, strlen(user->password));
     PQclear(res);
 
-    if (verify_result == ARGON2_OK) {
-        if (!delete_user_sessions(conn, user_id)) {
-            rollback_transaction(conn, res);
-            return QRESULT_INTERNAL_ERROR;
-        } else if (!db_create_session(conn, user_id, session_token, csrf_token)) {
-            fprintf(stderr, "Failed to create session\n");
-            rollback_transaction(conn, res);
-            return QRESULT_INTERNAL_ERROR;
-        }
-    } else {
-        if (!rollback_transaction(conn, res)) {
-            return QRESULT_INTERNAL_ERROR;
-        }
+    if (verify_result != ARGON2_OK) {
         return QRESULT_USER_ERROR;
     }
-    res = PQexec(conn, "COMMIT");
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        fprintf(stderr, "Failed to commit transaction: %s", PQerrorMessage(conn));
-        PQclear(res);
-        return QRESULT_INTERNAL_ERROR;
-    }
-    PQclear(res);
-    return QRESULT_OK;
+    return replace_user_sessions(conn, user_id, session_token);
 }
 
 
@@ -361,11 +309,8 @@ QueryResult db_update_user_email(PGconn *conn, int id, const char *email) {
     char id_str[10];
     snprintf(id_str, sizeof(id_str), "%d", id);
     const char *params[2] = {email, id_str};
-    const char *query = "UPDATE users SET email = $1 WHERE id = $2";
-    int param_lengths[2] = {strlen(email), strlen(id_str)};
-    int param_formats[2] = {0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 2, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_UPDATE_USER_EMAIL, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         if (strcmp(PQresultErrorField(res, PG_DIAG_SQLSTATE), "23505") == 0) {
@@ -407,12 +352,9 @@ bool db_reset_user_password(PGconn *conn, const char *vtoken, const char *passwo
         return false;
     }
 
-    const char *query = "UPDATE users SET password = $1, verification_token = NULL, token_expires_at = NULL WHERE verification_token = $2";
     const char *params[2] = {encoded, vtoken};
-    int param_lengths[2] = {strlen(encoded), strlen(vtoken)};
-    int param_formats[2] = {0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 2, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_RESET_PASSWORD, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "User password reset failed: %s", PQerrorMessage(conn));
@@ -454,11 +396,8 @@ bool db_update_user_password(PGconn *conn, int id, const char *password) {
     snprintf(id_str, sizeof(id_str), "%d", id);
 
     const char *params[2] = {encoded, id_str};
-    const char *query = "UPDATE users SET password = $1 WHERE id = $2";
-    int param_lengths[2] = {strlen(encoded), strlen(id_str)};
-    int param_formats[2] = {0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 2, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_UPDATE_PASSWORD, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "User password update failed: %s", PQerrorMessage(conn));
@@ -475,12 +414,9 @@ bool db_update_user_password(PGconn *conn, int id, const char *password) {
 
 
 bool db_delete_unverified_user(PGconn *conn, const char *email) {
-    const char *query = "DELETE FROM users WHERE email = $1 AND is_verified = false";
     const char *params[1] = {email};
-    int param_lengths[1] = {strlen(email)};
-    int param_formats[1] = {0};
 
-    PGresult *res = PQexecParams(conn, query, 1, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_DELETE_UNVERIFIED_USER, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "User deletion failed: %s", PQerrorMessage(conn));
@@ -497,10 +433,12 @@ bool db_delete_unverified_user(PGconn *conn, const char *email) {
 
 
 bool db_delete_user(PGconn *conn, int id) {
-    char query[64];
-    sprintf(query, "DELETE FROM users WHERE id = %d", id);
+    char id_str[12];
+    snprintf(id_str, sizeof(id_str), "%d", id);
+
+    const char *params[1] = {id_str};
 
-    PGresult *res = PQexec(conn, query);
+    PGresult *res = exec_statement(conn, STMT_DELETE_USER, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "User deletion failed: %s", PQerrorMessage(conn));
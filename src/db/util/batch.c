@@ -0,0 +1,82 @@
+#include "batch.h"
+#include <stdio.h>
+
+
+bool batch_begin(QueryBatch *batch, PGconn *conn) {
+    batch->conn = conn;
+    batch->pending = 0;
+    batch->sent = false;
+    if (!PQenterPipelineMode(conn)) {
+        fprintf(stderr, "Failed to enter pipeline mode: %s", PQerrorMessage(conn));
+        batch->conn = NULL;
+        return false;
+    }
+    return true;
+}
+
+
+bool batch_queue(QueryBatch *batch, StatementId id, const char *const *params) {
+    if (!send_statement(batch->conn, id, params)) {
+        fprintf(stderr, "Failed to queue statement: %s", PQerrorMessage(batch->conn));
+        return false;
+    }
+    batch->pending++;
+    return true;
+}
+
+
+bool batch_send(QueryBatch *batch) {
+    if (!PQpipelineSync(batch->conn)) {
+        fprintf(stderr, "Failed to send query batch: %s", PQerrorMessage(batch->conn));
+        return false;
+    }
+    batch->sent = true;
+    return true;
+}
+
+
+// results come back in the order the statements were queued, one each; NULL once the connection is gone
+PGresult *batch_next_result(QueryBatch *batch) {
+    if (batch->pending == 0) {
+        return NULL;
+    }
+    PGresult *res = PQgetResult(batch->conn);
+    if (!res) {
+        return NULL;
+    }
+    batch->pending--;
+
+    // every statement's results are terminated by a NULL
+    PGresult *next;
+    while ((next = PQgetResult(batch->conn))) {
+        PQclear(next);
+    }
+    return res;
+}
+
+
+// reads whatever the caller left unread and leaves pipeline mode, so the connection goes back to the pool usable.
+// Statements queued but never sent are sent here, the server has to answer them before the pipeline can be left
+void batch_end(QueryBatch *batch) {
+    if (!batch->conn) {
+        return;
+    }
+    if (!batch->sent && batch->pending > 0 && !batch_send(batch)) {
+        return;
+    }
+
+    PGresult *res;
+    while (batch->pending > 0 && (res = batch_next_result(batch))) {
+        PQclear(res);
+    }
+    if (batch->sent && batch->pending == 0) {
+        res = PQgetResult(batch->conn);
+        if (PQresultStatus(res) != PGRES_PIPELINE_SYNC) {
+            fprintf(stderr, "Query batch ended without its sync point: %s", PQerrorMessage(batch->conn));
+        }
+        PQclear(res);
+    }
+    if (!PQexitPipelineMode(batch->conn)) {
+        fprintf(stderr, "Failed to leave pipeline mode: %s", PQerrorMessage(batch->conn));
+    }
+}
\ No newline at end of file
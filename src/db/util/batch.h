@@ -0,0 +1,28 @@
+#ifndef HTTP_SERVER_BATCH_H
+#define HTTP_SERVER_BATCH_H
+
+#include "statements.h"
+#include <libpq-fe.h>
+
+
+// prepared statements queued on a connection in pipeline mode and sent in one round trip; everything queued runs as
+// one implicit transaction, so a statement that fails undoes the ones before it and aborts the ones after it
+typedef struct {
+    PGconn *conn;
+    int pending;
+    bool sent;
+} QueryBatch;
+
+
+bool batch_begin(QueryBatch *batch, PGconn *conn);
+
+bool batch_queue(QueryBatch *batch, StatementId id, const char *const *params);
+
+bool batch_send(QueryBatch *batch);
+
+PGresult *batch_next_result(QueryBatch *batch);
+
+void batch_end(QueryBatch *batch);
+
+
+#endif
@@ -0,0 +1,151 @@
+#include "statements.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SQLSTATE_DUPLICATE_STATEMENT "42P05"
+#define SQLSTATE_MISSING_STATEMENT "26000"
+
+
+// one page of a user's todos along with how many they have in all, in a single round trip; the count is the one a
+// trigger in init.sql keeps on the user's row, so a page never reads more todos than it shows. The page is
+// joined to the count so that a page past the end still comes back as one row, with NULLs where the todo would be.
+// The user is looked up by session token, so the page can be queued alongside the session check instead of after it;
+// an unknown or expired token reads as a user without todos
+#define TODO_PAGE_QUERY(filter, order) \
+    "WITH owner AS (SELECT user_id FROM sessions WHERE token = $1 AND expires_at > NOW()), " \
+    "total AS (SELECT COALESCE((SELECT todo_count FROM users WHERE id = (SELECT user_id FROM owner)), 0) AS total) " \
+    "SELECT page.id, page.creation_time, page.summary, page.task, page.due_time, total.total FROM total " \
+    "LEFT JOIN LATERAL (SELECT id, creation_time, summary, task, due_time FROM todos " \
+    "WHERE user_id = (SELECT user_id FROM owner)" filter " ORDER BY " order ") page ON TRUE " \
+    "ORDER BY page.id DESC"
+
+
+typedef struct {
+    const char *name;
+    const char *sql;
+    int param_count;
+} Statement;
+
+
+static const Statement STATEMENTS[STATEMENT_COUNT] = {
+    [STMT_TODO_PAGE] = {"todo_page", TODO_PAGE_QUERY("", "id DESC LIMIT $2 OFFSET $3"), 3},
+    [STMT_TODO_PAGE_AFTER] = {"todo_page_after", TODO_PAGE_QUERY(" AND id < $2", "id DESC LIMIT $3"), 3},
+    [STMT_TODO_PAGE_BEFORE] = {"todo_page_before", TODO_PAGE_QUERY(" AND id > $2", "id ASC LIMIT $3"), 3},
+    [STMT_CREATE_TODO] = {"create_todo", "INSERT INTO todos (user_id, summary, task) VALUES ($1, $2, $3)", 3},
+    [STMT_CREATE_TODO_DUE] = {"create_todo_due",
+                              "INSERT INTO todos (user_id, summary, task, due_time) VALUES ($1, $2, $3, $4)", 4},
+    [STMT_UPDATE_TODO] = {"update_todo", "UPDATE todos SET summary = $1, task = $2 WHERE id = $3 AND user_id = $4", 4},
+    [STMT_UPDATE_TODO_DUE] = {"update_todo_due",
+                              "UPDATE todos SET summary = $1, task = $2, due_time = $3 WHERE id = $4 AND "
+                              "user_id = $5", 5},
+    [STMT_DELETE_TODO] = {"delete_todo", "DELETE FROM todos WHERE id = $1 AND user_id = $2", 2},
+    [STMT_CREATE_SESSION] = {"create_session",
+                             "INSERT INTO sessions (user_id, token, csrf_token, expires_at) VALUES ($1, $2, "
+                             "$3, to_timestamp($4))", 4},
+    [STMT_GET_SESSION] = {"get_session",
+                          "SELECT user_id, csrf_token FROM sessions WHERE token = $1 AND expires_at > NOW()", 1},
+    [STMT_DELETE_SESSION] = {"delete_session", "DELETE FROM sessions WHERE token = $1", 1},
+    [STMT_DELETE_USER_SESSIONS] = {"delete_user_sessions", "DELETE FROM sessions WHERE user_id = $1", 1},
+    [STMT_RESET_TOKEN_EXISTS] = {"reset_token_exists",
+                                 "SELECT EXISTS (SELECT 1 FROM users WHERE is_verified = true AND "
+                                 "verification_token = $1 LIMIT 1)", 1},
+    [STMT_GET_VERIFICATION_TOKEN] = {"get_verification_token",
+                                     "SELECT is_verified, verification_token FROM users WHERE email = $1 AND "
+                                     "token_expires_at > NOW()", 1},
+    [STMT_SET_VERIFICATION_TOKEN] = {"set_verification_token",
+                                     "UPDATE users SET verification_token = $1, token_expires_at = "
+                                     "to_timestamp($2) WHERE email = $3", 3},
+    [STMT_VERIFY_EMAIL] = {"verify_email",
+                           "UPDATE users SET is_verified = true, verification_token = NULL, token_expires_at = "
+                           "NULL WHERE email = $1", 1},
+    [STMT_GET_USER_VERIFIED] = {"get_user_verified", "SELECT is_verified FROM users WHERE email = $1", 1},
+    [STMT_UPDATE_UNVERIFIED_USER] = {"update_unverified_user",
+                                     "UPDATE users SET password = $1, verification_token = $2, "
+                                     "token_expires_at = to_timestamp($3) WHERE email = $4", 4},
+    [STMT_SIGNUP_USER] = {"signup_user",
+                          "INSERT INTO users (email, password, verification_token, token_expires_at) VALUES "
+                          "($1, $2, $3, to_timestamp($4))", 4},
+    [STMT_GET_LOGIN] = {"get_login", "SELECT id, password, is_verified FROM users WHERE email = $1", 1},
+    [STMT_GET_USER_EMAIL] = {"get_user_email", "SELECT email FROM users WHERE id = $1", 1},
+    [STMT_UPDATE_USER_EMAIL] = {"update_user_email", "UPDATE users SET email = $1 WHERE id = $2", 2},
+    [STMT_RESET_PASSWORD] = {"reset_password",
+                             "UPDATE users SET password = $1, verification_token = NULL, token_expires_at = "
+                             "NULL WHERE verification_token = $2", 2},
+    [STMT_UPDATE_PASSWORD] = {"update_password", "UPDATE users SET password = $1 WHERE id = $2", 2},
+    [STMT_DELETE_UNVERIFIED_USER] = {"delete_unverified_user",
+                                     "DELETE FROM users WHERE email = $1 AND is_verified = false", 1},
+    [STMT_DELETE_USER] = {"delete_user", "DELETE FROM users WHERE id = $1", 1},
+    [STMT_CREATE_VERIFICATION_RESULT] = {"create_verification_result",
+                                         "INSERT INTO verification_results(token, message, success) VALUES "
+                                         "($1, $2, $3)", 3},
+    [STMT_GET_VERIFICATION_RESULT] = {"get_verification_result",
+                                      "SELECT expires_at, message, success FROM verification_results WHERE "
+                                      "token = $1 ORDER BY id DESC LIMIT 1", 1},
+    [STMT_VERIFIED_EMAIL_TAKEN] = {"verified_email_taken",
+                                   "SELECT EXISTS (SELECT 1 FROM users WHERE email = $1 AND is_verified = true "
+                                   "LIMIT 1)", 1},
+    [STMT_CREATE_EMAIL_CHANGE] = {"create_email_change",
+                                  "INSERT INTO email_change_requests(user_id, new_email, verification_token, "
+                                  "token_expires_at) VALUES ($1, $2, $3, to_timestamp($4))", 4},
+    [STMT_GET_EMAIL_CHANGE] = {"get_email_change",
+                               "SELECT user_id, verification_token FROM email_change_requests WHERE new_email "
+                               "= $1 AND token_expires_at > NOW() ORDER BY id DESC LIMIT 1", 1},
+    [STMT_DELETE_EMAIL_CHANGE] = {"delete_email_change",
+                                  "DELETE FROM email_change_requests WHERE verification_token = $1", 1},
+};
+
+
+static bool has_sqlstate(const PGresult *res, const char *sqlstate) {
+    const char *state = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+    return state && strcmp(state, sqlstate) == 0;
+}
+
+
+static bool prepare_statement(PGconn *conn, StatementId id) {
+    const Statement *statement = &STATEMENTS[id];
+    PGresult *res = PQprepare(conn, statement->name, statement->sql, statement->param_count, NULL);
+
+    // a statement left over from before a reconnect or an earlier call is just as good
+    if (PQresultStatus(res) != PGRES_COMMAND_OK && !has_sqlstate(res, SQLSTATE_DUPLICATE_STATEMENT)) {
+        fprintf(stderr, "Failed to prepare statement %s: %s", statement->name, PQerrorMessage(conn));
+        PQclear(res);
+        return false;
+    }
+    PQclear(res);
+    return true;
+}
+
+
+// prepared statements live as long as the session, so this runs after every (re)connect
+bool prepare_statements(PGconn *conn) {
+    for (int i = 0; i < STATEMENT_COUNT; ++i) {
+        if (!prepare_statement(conn, i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// parameters and results are both passed as text
+PGresult *exec_statement(PGconn *conn, StatementId id, const char *const *params) {
+    const Statement *statement = &STATEMENTS[id];
+    PGresult *res = PQexecPrepared(conn, statement->name, statement->param_count, params, NULL, NULL, 0);
+
+    // the server may have lost the statement (a DISCARD ALL, a pooler handing out another backend); it can only be
+    // prepared again outside a transaction, inside one the error is left for the caller's rollback
+    if (PQresultStatus(res) == PGRES_FATAL_ERROR && has_sqlstate(res, SQLSTATE_MISSING_STATEMENT) &&
+        PQtransactionStatus(conn) == PQTRANS_IDLE && prepare_statement(conn, id)) {
+        PQclear(res);
+        res = PQexecPrepared(conn, statement->name, statement->param_count, params, NULL, NULL, 0);
+    }
+    return res;
+}
+
+
+// queues the statement on a connection in pipeline mode; there's no retrying a lost statement there, the batch has
+// to fail as a whole
+bool send_statement(PGconn *conn, StatementId id, const char *const *params) {
+    const Statement *statement = &STATEMENTS[id];
+    return PQsendQueryPrepared(conn, statement->name, statement->param_count, params, NULL, NULL, 0) == 1;
+}
\ No newline at end of file
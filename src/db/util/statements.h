@@ -0,0 +1,52 @@
+#ifndef HTTP_SERVER_STATEMENTS_H
+#define HTTP_SERVER_STATEMENTS_H
+
+#include <libpq-fe.h>
+
+
+// every query the server runs with parameters, prepared once on each pooled connection
+typedef enum {
+    STMT_TODO_PAGE,
+    STMT_TODO_PAGE_AFTER,
+    STMT_TODO_PAGE_BEFORE,
+    STMT_CREATE_TODO,
+    STMT_CREATE_TODO_DUE,
+    STMT_UPDATE_TODO,
+    STMT_UPDATE_TODO_DUE,
+    STMT_DELETE_TODO,
+    STMT_CREATE_SESSION,
+    STMT_GET_SESSION,
+    STMT_DELETE_SESSION,
+    STMT_DELETE_USER_SESSIONS,
+    STMT_RESET_TOKEN_EXISTS,
+    STMT_GET_VERIFICATION_TOKEN,
+    STMT_SET_VERIFICATION_TOKEN,
+    STMT_VERIFY_EMAIL,
+    STMT_GET_USER_VERIFIED,
+    STMT_UPDATE_UNVERIFIED_USER,
+    STMT_SIGNUP_USER,
+    STMT_GET_LOGIN,
+    STMT_GET_USER_EMAIL,
+    STMT_UPDATE_USER_EMAIL,
+    STMT_RESET_PASSWORD,
+    STMT_UPDATE_PASSWORD,
+    STMT_DELETE_UNVERIFIED_USER,
+    STMT_DELETE_USER,
+    STMT_CREATE_VERIFICATION_RESULT,
+    STMT_GET_VERIFICATION_RESULT,
+    STMT_VERIFIED_EMAIL_TAKEN,
+    STMT_CREATE_EMAIL_CHANGE,
+    STMT_GET_EMAIL_CHANGE,
+    STMT_DELETE_EMAIL_CHANGE,
+    STATEMENT_COUNT
+} StatementId;
+
+
+bool prepare_statements(PGconn *conn);
+
+PGresult *exec_statement(PGconn *conn, StatementId id, const char *const *params);
+
+bool send_statement(PGconn *conn, StatementId id, const char *const *params);
+
+
+#endif
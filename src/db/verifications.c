@@ -1,15 +1,13 @@
 #include "verifications.h"
+#include "util/statements.h"
 #include <string.h>
 
 
 bool db_create_verification_result(PGconn *conn, VerificationResult *result) {
-    const char *query = "INSERT INTO verification_results(token, message, success) VALUES ($1, $2, $3)";
     const char *success_str = result->success ? "true" : "false";
     const char *params[3] = {result->token, result->message, success_str};
-    int param_lengths[3] = {strlen(result->token), strlen(result->message), strlen(success_str)};
-    int param_formats[3] = {0, 0, 0};
 
-    PGresult *res = PQexecParams(conn, query, 3, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_CREATE_VERIFICATION_RESULT, params);
 
     if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         fprintf(stderr, "Verification result creation failed: %s", PQerrorMessage(conn));
@@ -22,12 +20,9 @@ bool db_create_verification_result(PGconn *conn, VerificationResult *result) {
 
 
 QueryResult db_get_verification_result(PGconn *conn, VerificationResult *result) {
-    const char *query = "SELECT expires_at, message, success FROM verification_results WHERE token = $1 ORDER BY id DESC LIMIT 1";
     const char *params[1] = {result->token};
-    int param_lengths[1] = {strlen(result->token)};
-    int param_formats[1] = {0};
 
-    PGresult *res = PQexecParams(conn, query, 1, NULL, params, param_lengths, param_formats, 0);
+    PGresult *res = exec_statement(conn, STMT_GET_VERIFICATION_RESULT, params);
 
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         fprintf(stderr, "Verification result retrieval failed: %s", PQerrorMessage(conn));
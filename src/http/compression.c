@@ -0,0 +1,92 @@
+#include "compression.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GZIP_WINDOW_BITS (15 + 16)
+#define OUTPUT_RESERVE 4096
+
+
+typedef struct {
+    z_stream stream;
+    bool initialized;
+    char *output;
+    size_t capacity;
+    size_t length;
+} Compressor;
+
+// one gzip stream per worker, reset between responses instead of paying for deflateInit's allocations every time
+static _Thread_local Compressor compressor;
+
+
+// starts a new gzip member and forgets any output that wasn't consumed
+bool compressor_start() {
+    if (!compressor.initialized) {
+        memset(&compressor.stream, 0, sizeof(z_stream));
+        if (deflateInit2(&compressor.stream, COMPRESSION_LEVEL, Z_DEFLATED, GZIP_WINDOW_BITS, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            fprintf(stderr, "Failed to set up a deflate stream\n");
+            return false;
+        }
+        compressor.initialized = true;
+    } else if (deflateReset(&compressor.stream) != Z_OK) {
+        return false;
+    }
+    compressor.length = 0;
+    return true;
+}
+
+
+static bool reserve_output(size_t space) {
+    if (compressor.capacity - compressor.length >= space) {
+        return true;
+    }
+    size_t capacity = compressor.capacity ? compressor.capacity : OUTPUT_RESERVE * 4;
+    while (capacity - compressor.length < space) {
+        capacity *= 2;
+    }
+    char *output = realloc(compressor.output, capacity);
+    if (!output) {
+        perror("Failed to allocate memory for compressed output");
+        return false;
+    }
+    compressor.output = output;
+    compressor.capacity = capacity;
+    return true;
+}
+
+
+// flush is Z_NO_FLUSH while more is coming, Z_SYNC_FLUSH to make everything so far decodable, or Z_FINISH;
+// the output piles up until it's consumed
+bool compressor_deflate(const void *data, size_t length, int flush) {
+    z_stream *stream = &compressor.stream;
+    stream->next_in = (Bytef *)data;
+    stream->avail_in = length;
+    int status;
+    do {
+        if (!reserve_output(OUTPUT_RESERVE)) {
+            return false;
+        }
+        size_t space = compressor.capacity - compressor.length;
+        stream->next_out = (Bytef *)compressor.output + compressor.length;
+        stream->avail_out = space;
+        status = deflate(stream, flush);
+        if (status == Z_STREAM_ERROR) {
+            fprintf(stderr, "deflate failed\n");
+            return false;
+        }
+        compressor.length += space - stream->avail_out;
+    } while (stream->avail_out == 0 && status != Z_STREAM_END);
+    return true;
+}
+
+
+const char *compressor_output(size_t *length) {
+    *length = compressor.length;
+    return compressor.output;
+}
+
+
+void compressor_consume() {
+    compressor.length = 0;
+}
\ No newline at end of file
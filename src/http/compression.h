@@ -0,0 +1,20 @@
+#ifndef HTTP_SERVER_COMPRESSION_H
+#define HTTP_SERVER_COMPRESSION_H
+
+#include <stddef.h>
+#include <zlib.h>
+
+#define COMPRESSION_LEVEL 6
+#define COMPRESSION_MIN_SIZE 1024
+
+
+bool compressor_start();
+
+bool compressor_deflate(const void *data, size_t length, int flush);
+
+const char *compressor_output(size_t *length);
+
+void compressor_consume();
+
+
+#endif
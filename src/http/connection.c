@@ -0,0 +1,178 @@
+#include "connection.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#define MAX_REGISTRY_SIZE (1 << 20)
+#define INITIAL_BUFFER_SIZE 4096
+#define MIN_READ_SIZE 1024
+
+
+// open connections indexed by their socket, so response code can reach the connection state
+static Connection **registry = NULL;
+static int registry_size = 0;
+
+
+bool connection_registry_init() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+        perror("Failed to get the file descriptor limit");
+        return false;
+    }
+    registry_size = limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > MAX_REGISTRY_SIZE
+                    ? MAX_REGISTRY_SIZE : (int)limit.rlim_cur;
+
+    registry = calloc(registry_size, sizeof(Connection *));
+    if (!registry) {
+        perror("Failed to allocate memory for the connection registry");
+        return false;
+    }
+    return true;
+}
+
+
+Connection *connection_create(int client_socket, EventLoop *loop) {
+    if (client_socket >= registry_size) {
+        fprintf(stderr, "Socket %d exceeds the connection registry size\n", client_socket);
+        return NULL;
+    }
+    Connection *conn = calloc(1, sizeof(Connection));
+    if (!conn) {
+        perror("Failed to allocate memory for the connection");
+        return NULL;
+    }
+    conn->client_socket = client_socket;
+    conn->loop = loop;
+    registry[client_socket] = conn;
+    return conn;
+}
+
+
+Connection *connection_find(int client_socket) {
+    if (client_socket < 0 || client_socket >= registry_size) {
+        return NULL;
+    }
+    return registry[client_socket];
+}
+
+
+// makes room for at least extra more bytes plus the terminating NUL
+static bool reserve_buffer(Connection *conn, size_t extra) {
+    // bytes of already served pipelined requests are only dropped once more data has to fit in
+    if (conn->start > 0) {
+        conn->length -= conn->start;
+        memmove(conn->buffer, conn->buffer + conn->start, conn->length + 1);
+        conn->start = 0;
+    }
+    if (conn->length + extra + 1 <= conn->buffer_size) {
+        return true;
+    }
+
+    // doubling keeps the copying linear in the size of large requests
+    size_t new_size = conn->buffer_size ? conn->buffer_size * 2 : INITIAL_BUFFER_SIZE;
+    if (new_size < conn->length + extra + 1) {
+        new_size = conn->length + extra + 1;
+    }
+    char *new_buffer = realloc(conn->buffer, new_size);
+    if (!new_buffer) {
+        perror("Failed to allocate memory for the new request buffer");
+        return false;
+    }
+    conn->buffer = new_buffer;
+    conn->buffer_size = new_size;
+    return true;
+}
+
+
+// a malformed request counts as complete too, parsing it is what reports the error
+static ConnectionReadStatus read_status(Connection *conn) {
+    RequestParsingStatus status = request_parser_feed(&conn->parser, conn->buffer + conn->start,
+                                                      conn->length - conn->start);
+    if (status != REQ_PARSE_INCOMPLETE) {
+        conn->request_length = status == REQ_PARSE_SUCCESS ? request_parser_length(&conn->parser) : 0;
+        return CONN_READ_REQUEST;
+    }
+    return conn->read_closed ? CONN_READ_CLOSED : CONN_READ_AGAIN;
+}
+
+
+// reads until the socket runs dry or the request is framed; sends on the socket wait out a full buffer in poll instead
+ConnectionReadStatus connection_read(Connection *conn) {
+    while (1) {
+        if (!reserve_buffer(conn, MIN_READ_SIZE)) {
+            return CONN_READ_CLOSED;
+        }
+
+        ssize_t bytes_received = recv(conn->client_socket, conn->buffer + conn->length,
+                                      conn->buffer_size - conn->length - 1, MSG_DONTWAIT);
+        if (bytes_received < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            perror("recv failed");
+            return CONN_READ_CLOSED;
+        } else if (bytes_received == 0) {
+            conn->read_closed = true;
+            break;
+        }
+
+        conn->length += bytes_received;
+        conn->buffer[conn->length] = '\0';
+        // framing after every read stops it at the end of the request, or as soon as the request is too large, so
+        // the buffer never grows past MAX_HEADER_SIZE and MAX_BODY_SIZE by more than one read; whatever the client
+        // pipelined after it stays in the socket until the connection is watched again
+        if (read_status(conn) == CONN_READ_REQUEST) {
+            return CONN_READ_REQUEST;
+        }
+    }
+    return read_status(conn);
+}
+
+
+// same as connection_read, for bytes that were already received on the connection's behalf
+ConnectionReadStatus connection_received(Connection *conn, const char *data, size_t length) {
+    if (!reserve_buffer(conn, length)) {
+        return CONN_READ_CLOSED;
+    }
+    memcpy(conn->buffer + conn->length, data, length);
+    conn->length += length;
+    conn->buffer[conn->length] = '\0';
+    return read_status(conn);
+}
+
+
+RequestParsingStatus connection_parse_request(Connection *conn) {
+    memset(&conn->request, 0, sizeof(HttpRequest));
+    return parse_http_request(conn->buffer + conn->start, &conn->parser, &conn->request);
+}
+
+
+// only needed once the client stopped sending, so scanning the rest ahead of time is fine
+bool connection_has_pipelined_request(const Connection *conn) {
+    RequestParser parser;
+    request_parser_reset(&parser);
+    size_t next = conn->start + conn->request_length;
+    return request_parser_feed(&parser, conn->buffer + next, conn->length - next) != REQ_PARSE_INCOMPLETE;
+}
+
+
+bool connection_next_request(Connection *conn) {
+    conn->start += conn->request_length;
+    conn->request_length = 0;
+    request_parser_reset(&conn->parser);
+    return conn->start < conn->length && read_status(conn) == CONN_READ_REQUEST;
+}
+
+
+void connection_close(Connection *conn) {
+    registry[conn->client_socket] = NULL;
+    close(conn->client_socket);
+    free(conn->buffer);
+    free(conn);
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef HTTP_SERVER_CONNECTION_H
+#define HTTP_SERVER_CONNECTION_H
+
+#include "request.h"
+#include <stddef.h>
+#include <time.h>
+
+
+typedef struct EventLoop EventLoop;
+
+typedef struct Connection {
+    int client_socket;
+    EventLoop *loop;
+    char *buffer;
+    size_t buffer_size;
+    size_t length;
+    size_t start;
+    size_t request_length;
+    RequestParser parser;
+    HttpRequest request;
+    bool keep_alive;
+    bool compressible;
+    bool accepts_gzip;
+    bool read_closed;
+    bool closing;
+    int requests_served;
+    time_t last_active;
+    struct Connection *prev;
+    struct Connection *next;
+} Connection;
+
+typedef enum {
+    CONN_READ_AGAIN,
+    CONN_READ_REQUEST,
+    CONN_READ_CLOSED,
+} ConnectionReadStatus;
+
+bool connection_registry_init();
+
+Connection *connection_create(int client_socket, EventLoop *loop);
+
+Connection *connection_find(int client_socket);
+
+ConnectionReadStatus connection_read(Connection *conn);
+
+ConnectionReadStatus connection_received(Connection *conn, const char *data, size_t length);
+
+RequestParsingStatus connection_parse_request(Connection *conn);
+
+bool connection_has_pipelined_request(const Connection *conn);
+
+bool connection_next_request(Connection *conn);
+
+void connection_close(Connection *conn);
+
+
+#endif
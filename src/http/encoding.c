@@ -0,0 +1,128 @@
+#include "encoding.h"
+#include <string.h>
+#include <strings.h>
+
+#define QVALUE_MAX 1000
+
+
+static const struct {
+    const char *name;
+    const char *suffix;
+} ENCODINGS[ENCODING_COUNT] = {
+        [ENCODING_IDENTITY] = {"identity", ""},
+        [ENCODING_BR] = {"br", ".br"},
+        [ENCODING_GZIP] = {"gzip", ".gz"},
+};
+
+
+const char *encoding_name(ContentEncoding encoding) {
+    return ENCODINGS[encoding].name;
+}
+
+
+const char *encoding_suffix(ContentEncoding encoding) {
+    return ENCODINGS[encoding].suffix;
+}
+
+
+// the encoding a precompressed sidecar is stored in, judging by its name, and the length of the name without it
+ContentEncoding encoding_from_suffix(const char *path, size_t *base_length) {
+    size_t length = strlen(path);
+    for (int encoding = ENCODING_IDENTITY + 1; encoding < ENCODING_COUNT; ++encoding) {
+        size_t suffix_length = strlen(ENCODINGS[encoding].suffix);
+        if (length > suffix_length && strcmp(path + length - suffix_length, ENCODINGS[encoding].suffix) == 0) {
+            *base_length = length - suffix_length;
+            return encoding;
+        }
+    }
+    *base_length = length;
+    return ENCODING_IDENTITY;
+}
+
+
+// images and archives are compressed already, and gain nothing from another pass
+bool is_compressible(const char *content_type) {
+    return content_type && (strncmp(content_type, "text/", 5) == 0 ||
+                            strcmp(content_type, "application/javascript") == 0 ||
+                            strcmp(content_type, "application/json") == 0 ||
+                            strcmp(content_type, "image/svg+xml") == 0);
+}
+
+
+// "q=0.5" as 500; anything that isn't a valid qvalue counts as 1
+static int parse_qvalue(const char *p, const char *end) {
+    if (end - p < 3 || (p[0] != 'q' && p[0] != 'Q') || p[1] != '=') {
+        return QVALUE_MAX;
+    }
+    p += 2;
+    if (*p != '0') {
+        return QVALUE_MAX;
+    }
+    int value = 0;
+    int scale = 100;
+    if (++p < end && *p == '.') {
+        for (++p; p < end && *p >= '0' && *p <= '9' && scale > 0; ++p, scale /= 10) {
+            value += (*p - '0') * scale;
+        }
+    }
+    return value;
+}
+
+
+// picks the available coding the client rates highest, identity when it accepts none of them
+ContentEncoding negotiate_encoding(const HttpRequest *request, unsigned available) {
+    Slice header = request ? request_header(request, HDR_ACCEPT_ENCODING) : (Slice) {NULL, 0};
+    if (!header.ptr || !(available & ~ENCODING_BIT(ENCODING_IDENTITY))) {
+        return ENCODING_IDENTITY;
+    }
+
+    int qvalues[ENCODING_COUNT] = {0};
+    int wildcard = -1;
+    const char *p = header.ptr;
+    const char *end = header.ptr + header.len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) {
+            p++;
+        }
+        const char *name = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        size_t name_length = p - name;
+        int qvalue = QVALUE_MAX;
+        while (p < end && *p != ',') {
+            if (*p == ';') {
+                const char *parameter = p + 1;
+                while (parameter < end && (*parameter == ' ' || *parameter == '\t')) {
+                    parameter++;
+                }
+                qvalue = parse_qvalue(parameter, end);
+            }
+            p++;
+        }
+
+        // -1 marks a coding the client turned down by name, so the wildcard doesn't override it
+        if (name_length == 1 && name[0] == '*') {
+            wildcard = qvalue;
+        } else if (name_length == 6 && strncasecmp(name, "x-gzip", 6) == 0) {
+            qvalues[ENCODING_GZIP] = qvalue ? qvalue : -1;
+        }
+        for (int encoding = ENCODING_IDENTITY + 1; encoding < ENCODING_COUNT; ++encoding) {
+            if (name_length == strlen(ENCODINGS[encoding].name) &&
+                strncasecmp(name, ENCODINGS[encoding].name, name_length) == 0) {
+                qvalues[encoding] = qvalue ? qvalue : -1;
+            }
+        }
+    }
+
+    ContentEncoding best = ENCODING_IDENTITY;
+    int best_qvalue = 0;
+    for (int encoding = ENCODING_IDENTITY + 1; encoding < ENCODING_COUNT; ++encoding) {
+        int qvalue = qvalues[encoding] == 0 && wildcard > 0 ? wildcard : qvalues[encoding];
+        if ((available & ENCODING_BIT(encoding)) && qvalue > best_qvalue) {
+            best = encoding;
+            best_qvalue = qvalue;
+        }
+    }
+    return best;
+}
\ No newline at end of file
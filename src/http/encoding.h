@@ -0,0 +1,28 @@
+#ifndef HTTP_SERVER_ENCODING_H
+#define HTTP_SERVER_ENCODING_H
+
+#include "request.h"
+
+#define ENCODING_BIT(encoding) (1u << (encoding))
+
+
+// in order of preference when the client likes several equally
+typedef enum {
+    ENCODING_IDENTITY,
+    ENCODING_BR,
+    ENCODING_GZIP,
+    ENCODING_COUNT,
+} ContentEncoding;
+
+const char *encoding_name(ContentEncoding encoding);
+
+const char *encoding_suffix(ContentEncoding encoding);
+
+ContentEncoding encoding_from_suffix(const char *path, size_t *base_length);
+
+bool is_compressible(const char *content_type);
+
+ContentEncoding negotiate_encoding(const HttpRequest *request, unsigned available);
+
+
+#endif
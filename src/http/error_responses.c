@@ -0,0 +1,222 @@
+#include "error_responses.h"
+#include "headers.h"
+#include "response.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define MAX_STATUS_CODE 600
+#define FALLBACK_ERROR_PAGE "<h1>Internal Server Error</h1>\r\n" \
+                            "\t<p>Sorry, something went wrong on our side. Please try again later.</p>\r\n"
+
+
+typedef struct {
+    int status_code;
+    char *message;
+    PreformattedResponse responses[2];
+} ErrorMessage;
+
+// pages are indexed by status and keep-alive; a status without a page of its own gets the 500 one
+static PreformattedResponse pages[MAX_STATUS_CODE][2];
+
+// envelopes are rendered the first time their message is sent and kept from then on, so every slot is written
+// once, under the mutex, and read without it
+static ErrorMessage *messages[MAX_ERROR_MESSAGES];
+static pthread_mutex_t messages_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static bool preformat(PreformattedResponse *response, int status_code, const char *content_type, bool keep_alive,
+                      const char *other, const char *body, size_t body_length) {
+    char header[HEADER_BLOCK_SIZE];
+    size_t header_length = format_header_block(header, status_code, content_type, keep_alive, other);
+    if (header_length == 0) {
+        return false;
+    }
+    response->data = malloc(header_length + body_length);
+    if (!response->data) {
+        perror("Failed to allocate memory for an error response");
+        return false;
+    }
+    memcpy(response->data, header, header_length);
+    memcpy(response->data + header_length, body, body_length);
+    response->length = header_length + body_length;
+    response->date_offset = strstr(header, "\r\n") + 2 - header;
+    return true;
+}
+
+
+static bool preformat_page(int status_code, const char *body, size_t body_length, const Validators *validators) {
+    char other[FILE_HEADERS_SIZE];
+    format_file_headers(other, body_length, validators, ENCODING_IDENTITY, false, false);
+    for (int keep_alive = 0; keep_alive < 2; ++keep_alive) {
+        if (!preformat(&pages[status_code][keep_alive], status_code, "text/html", keep_alive, other, body,
+                       body_length)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// false only if the file is there but couldn't be read
+static bool load_page(const char *errors_root, int status_code) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%d.html", errors_root, status_code);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return true;
+    }
+    struct stat file_stat;
+    char *body = NULL;
+    size_t bytes_read = 0;
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+        body = malloc(file_stat.st_size > 0 ? file_stat.st_size : 1);
+    }
+    while (body && bytes_read < (size_t)file_stat.st_size) {
+        ssize_t result = read(fd, body + bytes_read, file_stat.st_size - bytes_read);
+        if (result <= 0) {
+            break;
+        }
+        bytes_read += result;
+    }
+    close(fd);
+
+    bool loaded = body && bytes_read == (size_t)file_stat.st_size;
+    if (loaded) {
+        Validators validators;
+        validators_init(&validators, file_stat.st_size, file_stat.st_mtim.tv_sec, file_stat.st_mtim.tv_nsec,
+                        ENCODING_IDENTITY);
+        loaded = preformat_page(status_code, body, bytes_read, &validators);
+    } else {
+        fprintf(stderr, "Failed to read %s\n", path);
+    }
+    free(body);
+    return loaded;
+}
+
+
+// renders every error page under errors_root; has to run after headers_init
+bool error_responses_init(const char *errors_root) {
+    int count = 0;
+    for (int status_code = 400; status_code < MAX_STATUS_CODE; ++status_code) {
+        if (!load_page(errors_root, status_code)) {
+            return false;
+        }
+        count += pages[status_code][0].data != NULL;
+    }
+    if (!pages[500][0].data) {
+        fprintf(stderr, "No 500 page in %s, using a built-in one\n", errors_root);
+        char other[FILE_HEADERS_SIZE];
+        snprintf(other, sizeof(other), "Content-Length: %zu\r\n", sizeof(FALLBACK_ERROR_PAGE) - 1);
+        for (int keep_alive = 0; keep_alive < 2; ++keep_alive) {
+            if (!preformat(&pages[500][keep_alive], 500, "text/html", keep_alive, other, FALLBACK_ERROR_PAGE,
+                           sizeof(FALLBACK_ERROR_PAGE) - 1)) {
+                return false;
+            }
+        }
+    }
+    printf("Error pages: %d preloaded\n", count);
+    return true;
+}
+
+
+const PreformattedResponse *error_page(int status_code, bool keep_alive) {
+    if (status_code < 0 || status_code >= MAX_STATUS_CODE || !pages[status_code][keep_alive].data) {
+        status_code = 500;
+    }
+    return &pages[status_code][keep_alive];
+}
+
+
+// the message as a JSON string, quotes and control characters escaped; buffer holds MAX_ERROR_JSON_LENGTH bytes
+size_t format_error_json(char *buffer, const char *message) {
+    static const char hex[] = "0123456789abcdef";
+    const char prefix[] = "{\"error\": {\"message\": \"";
+    const char suffix[] = "\"}}\n";
+    size_t length = sizeof(prefix) - 1;
+    memcpy(buffer, prefix, length);
+    size_t limit = MAX_ERROR_JSON_LENGTH - sizeof(suffix) - 6;
+    for (const unsigned char *p = (const unsigned char *)message; *p && length < limit; ++p) {
+        if (*p == '"' || *p == '\\') {
+            buffer[length++] = '\\';
+            buffer[length++] = *p;
+        } else if (*p < 0x20) {
+            memcpy(buffer + length, "\\u00", 4);
+            buffer[length + 4] = hex[*p >> 4];
+            buffer[length + 5] = hex[*p & 0xf];
+            length += 6;
+        } else {
+            buffer[length++] = *p;
+        }
+    }
+    memcpy(buffer + length, suffix, sizeof(suffix) - 1);
+    return length + sizeof(suffix) - 1;
+}
+
+
+static unsigned hash_message(int status_code, const char *message) {
+    unsigned hash = 2166136261u ^ status_code;
+    for (const unsigned char *p = (const unsigned char *)message; *p; ++p) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash & (MAX_ERROR_MESSAGES - 1);
+}
+
+
+static ErrorMessage *render_message(int status_code, const char *message) {
+    ErrorMessage *entry = calloc(1, sizeof(ErrorMessage));
+    if (!entry) {
+        return NULL;
+    }
+    entry->status_code = status_code;
+    entry->message = strdup(message);
+
+    char body[MAX_ERROR_JSON_LENGTH];
+    size_t body_length = format_error_json(body, message);
+    char content_length[64];
+    snprintf(content_length, sizeof(content_length), "Content-Length: %zu\r\n", body_length);
+    for (int keep_alive = 0; entry->message && keep_alive < 2; ++keep_alive) {
+        if (!preformat(&entry->responses[keep_alive], status_code, "application/json", keep_alive, content_length,
+                       body, body_length)) {
+            free(entry->responses[0].data);
+            free(entry->message);
+            free(entry);
+            return NULL;
+        }
+    }
+    if (!entry->message) {
+        free(entry);
+        return NULL;
+    }
+    return entry;
+}
+
+
+// NULL only when the table is full or memory ran out; messages are told apart by content, not by address,
+// so ones formatted into a local buffer are found again too
+const PreformattedResponse *error_message(int status_code, const char *message, bool keep_alive) {
+    unsigned slot = hash_message(status_code, message);
+    for (int probes = 0; probes < MAX_ERROR_MESSAGES; ++probes, slot = (slot + 1) & (MAX_ERROR_MESSAGES - 1)) {
+        ErrorMessage *entry = __atomic_load_n(&messages[slot], __ATOMIC_ACQUIRE);
+        if (!entry) {
+            pthread_mutex_lock(&messages_mutex);
+            entry = messages[slot];
+            if (!entry) {
+                entry = render_message(status_code, message);
+                __atomic_store_n(&messages[slot], entry, __ATOMIC_RELEASE);
+            }
+            pthread_mutex_unlock(&messages_mutex);
+            if (!entry) {
+                return NULL;
+            }
+        }
+        if (entry->status_code == status_code && strcmp(entry->message, message) == 0) {
+            return &entry->responses[keep_alive];
+        }
+    }
+    return NULL;
+}
\ No newline at end of file
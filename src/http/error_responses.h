@@ -0,0 +1,27 @@
+#ifndef HTTP_SERVER_ERROR_RESPONSES_H
+#define HTTP_SERVER_ERROR_RESPONSES_H
+
+#include <stddef.h>
+
+#define MAX_ERROR_MESSAGES 256
+#define MAX_ERROR_JSON_LENGTH 512
+
+
+// a whole response, status line to body, that never changes once it's built; its Date line is stale and is
+// replaced on the way out, at date_offset
+typedef struct {
+    char *data;
+    size_t length;
+    size_t date_offset;
+} PreformattedResponse;
+
+bool error_responses_init(const char *errors_root);
+
+const PreformattedResponse *error_page(int status_code, bool keep_alive);
+
+const PreformattedResponse *error_message(int status_code, const char *message, bool keep_alive);
+
+size_t format_error_json(char *buffer, const char *message);
+
+
+#endif
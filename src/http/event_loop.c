@@ -0,0 +1,517 @@
+#define _GNU_SOURCE
+
+#include "event_loop.h"
+#include "response.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#ifdef USE_IO_URING
+#include "util/uring.h"
+#include <poll.h>
+#endif
+
+#define CLIENT_EVENTS (EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT)
+#define URING_ENTRIES 1024
+#define URING_BUFFER_COUNT 1024
+#define URING_BUFFER_SIZE 4096
+#define URING_BUFFER_GROUP 0
+#define URING_TAG_MASK 7
+
+
+static time_t monotonic_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+
+// a connection is only held to the keep-alive timeout once it has been answered, until then it has the request
+// timeout to get its first request in; requests_served doesn't change while the loop tracks the connection
+static IdleList *idle_list_of(EventLoop *loop, const Connection *conn) {
+    return conn->requests_served > 0 ? &loop->idle : &loop->waiting;
+}
+
+
+// both lists are kept oldest first, so expiring them only ever looks at the heads
+static void track_connection(EventLoop *loop, Connection *conn) {
+    IdleList *list = idle_list_of(loop, conn);
+    conn->last_active = loop->now;
+    conn->next = NULL;
+    conn->prev = list->tail;
+    if (list->tail) {
+        list->tail->next = conn;
+    } else {
+        list->head = conn;
+    }
+    list->tail = conn;
+}
+
+
+static void untrack_connection(EventLoop *loop, Connection *conn) {
+    IdleList *list = idle_list_of(loop, conn);
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        list->head = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    } else {
+        list->tail = conn->prev;
+    }
+    conn->prev = conn->next = NULL;
+}
+
+
+static bool watch_connection(EventLoop *loop, Connection *conn, int op) {
+    struct epoll_event event = {.events = CLIENT_EVENTS, .data.ptr = conn};
+    if (epoll_ctl(loop->epoll_fd, op, conn->client_socket, &event) == -1) {
+        perror("Failed to watch the client socket");
+        return false;
+    }
+    return true;
+}
+
+
+bool event_loop_init(EventLoop *loop, int server_socket, int request_timeout, int idle_timeout,
+                     bool (*dispatch)(Connection *conn)) {
+    loop->server_socket = server_socket;
+    loop->now = monotonic_seconds();
+    loop->waiting = (IdleList) {NULL, NULL, request_timeout};
+    loop->idle = (IdleList) {NULL, NULL, idle_timeout};
+    loop->resumed = NULL;
+    loop->dispatch = dispatch;
+    pthread_mutex_init(&loop->resumed_mutex, NULL);
+
+    int flags = fcntl(server_socket, F_GETFL, 0);
+    if (flags == -1 || fcntl(server_socket, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("Failed to make the server socket non-blocking");
+        return false;
+    }
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd == -1) {
+        perror("epoll_create1 failed");
+        return false;
+    }
+    loop->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->wakeup_fd == -1) {
+        perror("eventfd failed");
+        close(loop->epoll_fd);
+        return false;
+    }
+
+    // the loop itself stands for the listening socket in event data, its wakeup_fd for the eventfd
+    struct epoll_event event = {.events = EPOLLIN | EPOLLET, .data.ptr = loop};
+    struct epoll_event wakeup_event = {.events = EPOLLIN | EPOLLET, .data.ptr = &loop->wakeup_fd};
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, server_socket, &event) == -1 ||
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wakeup_fd, &wakeup_event) == -1) {
+        perror("Failed to set up the event loop");
+        close(loop->wakeup_fd);
+        close(loop->epoll_fd);
+        return false;
+    }
+    return true;
+}
+
+
+// client sockets are non-blocking, so a client that stops reading can only hold up a send for SEND_TIMEOUT_MS
+static void accept_connections(EventLoop *loop) {
+    while (1) {
+        int client_socket = accept4(loop->server_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_socket < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Accept failed");
+            }
+            return;
+        }
+
+        Connection *conn = connection_create(client_socket, loop);
+        if (!conn) {
+            close(client_socket);
+            continue;
+        }
+        if (!watch_connection(loop, conn, EPOLL_CTL_ADD)) {
+            connection_close(conn);
+            continue;
+        }
+        track_connection(loop, conn);
+        printf("New connection accepted\n");
+    }
+}
+
+
+// takes the connection out of the loop once it holds a complete request
+static void dispatch_request(EventLoop *loop, Connection *conn) {
+    RequestParsingStatus parsing_status = connection_parse_request(conn);
+    if (parsing_status != REQ_PARSE_SUCCESS) {
+        conn->keep_alive = false;
+        handle_invalid_http_request(parsing_status, conn->client_socket);
+        connection_close(conn);
+        return;
+    }
+
+    // from here on the connection belongs to a worker until it gets closed or resumed
+    if (!loop->dispatch(conn)) {
+        conn->keep_alive = false;
+        try_sending_error_file(conn->client_socket, 503);
+        connection_close(conn);
+    }
+}
+
+
+static void handle_client_event(EventLoop *loop, Connection *conn) {
+    ConnectionReadStatus status = connection_read(conn);
+    untrack_connection(loop, conn);
+
+    if (status == CONN_READ_AGAIN) {
+        if (watch_connection(loop, conn, EPOLL_CTL_MOD)) {
+            track_connection(loop, conn);
+            return;
+        }
+        status = CONN_READ_CLOSED;
+    }
+    if (status == CONN_READ_CLOSED) {
+        connection_close(conn);
+        return;
+    }
+    dispatch_request(loop, conn);
+}
+
+
+void event_loop_resume(Connection *conn) {
+    EventLoop *loop = conn->loop;
+
+    pthread_mutex_lock(&loop->resumed_mutex);
+    conn->next = loop->resumed;
+    loop->resumed = conn;
+    pthread_mutex_unlock(&loop->resumed_mutex);
+
+    uint64_t one = 1;
+    if (write(loop->wakeup_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("Failed to wake up the event loop");
+    }
+}
+
+
+// hands over the connections workers are done with, clearing the wakeup
+static Connection *take_resumed_connections(EventLoop *loop) {
+    uint64_t count;
+    while (read(loop->wakeup_fd, &count, sizeof(count)) > 0);
+
+    pthread_mutex_lock(&loop->resumed_mutex);
+    Connection *conn = loop->resumed;
+    loop->resumed = NULL;
+    pthread_mutex_unlock(&loop->resumed_mutex);
+    return conn;
+}
+
+
+static void rearm_resumed_connections(EventLoop *loop) {
+    Connection *conn = take_resumed_connections(loop);
+    while (conn) {
+        Connection *next = conn->next;
+        if (watch_connection(loop, conn, EPOLL_CTL_MOD)) {
+            track_connection(loop, conn);
+        } else {
+            connection_close(conn);
+        }
+        conn = next;
+    }
+}
+
+
+static void expire_connections(EventLoop *loop, IdleList *list, void (*close_connection)(Connection *conn)) {
+    while (list->head && loop->now - list->head->last_active >= list->timeout) {
+        Connection *conn = list->head;
+        untrack_connection(loop, conn);
+        close_connection(conn);
+    }
+}
+
+
+static void close_idle_connections(EventLoop *loop, void (*close_connection)(Connection *conn)) {
+    expire_connections(loop, &loop->waiting, close_connection);
+    expire_connections(loop, &loop->idle, close_connection);
+}
+
+
+#ifdef USE_IO_URING
+// every operation's user data is a pointer with one of these tags in its low bits
+enum {
+    URING_RECV,
+    URING_ACCEPT,
+    URING_WAKEUP,
+    URING_TIMEOUT,
+};
+
+typedef struct {
+    Ring ring;
+    BufferRing buffers;
+    struct __kernel_timespec tick;
+} UringLoop;
+
+
+static bool uring_submit_recv(UringLoop *uring, Connection *conn) {
+    struct io_uring_sqe *sqe = ring_get_sqe(&uring->ring);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->client_socket;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = (uintptr_t)conn | URING_RECV;
+    return true;
+}
+
+
+static bool uring_submit_accept(UringLoop *uring, EventLoop *loop) {
+    struct io_uring_sqe *sqe = ring_get_sqe(&uring->ring);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = loop->server_socket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = (uintptr_t)loop | URING_ACCEPT;
+    return true;
+}
+
+
+static bool uring_submit_wakeup(UringLoop *uring, EventLoop *loop) {
+    struct io_uring_sqe *sqe = ring_get_sqe(&uring->ring);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = loop->wakeup_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = (uintptr_t)loop | URING_WAKEUP;
+    return true;
+}
+
+
+static bool uring_submit_timeout(UringLoop *uring, EventLoop *loop) {
+    struct io_uring_sqe *sqe = ring_get_sqe(&uring->ring);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uintptr_t)&uring->tick;
+    sqe->len = 1;
+    sqe->user_data = (uintptr_t)loop | URING_TIMEOUT;
+    return true;
+}
+
+
+// a connection with a receive in flight can't be freed yet, so it's shut down and closed once that completes
+static void shutdown_connection(Connection *conn) {
+    conn->closing = true;
+    shutdown(conn->client_socket, SHUT_RDWR);
+}
+
+
+static void uring_accept(EventLoop *loop, UringLoop *uring, const struct io_uring_cqe *cqe) {
+    if (cqe->res >= 0) {
+        Connection *conn = connection_create(cqe->res, loop);
+        if (!conn) {
+            close(cqe->res);
+        } else if (!uring_submit_recv(uring, conn)) {
+            connection_close(conn);
+        } else {
+            track_connection(loop, conn);
+            printf("New connection accepted\n");
+        }
+    } else if (cqe->res != -EAGAIN && cqe->res != -EINTR) {
+        fprintf(stderr, "Accept failed: %s\n", strerror(-cqe->res));
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE) && !uring_submit_accept(uring, loop)) {
+        fprintf(stderr, "Failed to resubmit the accept operation\n");
+    }
+}
+
+
+static void uring_receive(EventLoop *loop, UringLoop *uring, Connection *conn, const struct io_uring_cqe *cqe) {
+    // all buffers are taken, the retry gets one of those recycled in this batch
+    if (cqe->res == -ENOBUFS && !conn->closing && uring_submit_recv(uring, conn)) {
+        return;
+    }
+    if (cqe->res <= 0 || conn->closing) {
+        if (cqe->flags & IORING_CQE_F_BUFFER) {
+            buffer_ring_recycle(&uring->buffers, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        if (cqe->res < 0 && !conn->closing) {
+            fprintf(stderr, "recv failed: %s\n", strerror(-cqe->res));
+        }
+        if (!conn->closing) {
+            untrack_connection(loop, conn);
+        }
+        connection_close(conn);
+        return;
+    }
+
+    unsigned short id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    ConnectionReadStatus status = connection_received(conn, buffer_ring_get(&uring->buffers, id), cqe->res);
+    buffer_ring_recycle(&uring->buffers, id);
+    untrack_connection(loop, conn);
+
+    if (status == CONN_READ_AGAIN) {
+        if (uring_submit_recv(uring, conn)) {
+            track_connection(loop, conn);
+            return;
+        }
+        status = CONN_READ_CLOSED;
+    }
+    if (status == CONN_READ_CLOSED) {
+        connection_close(conn);
+        return;
+    }
+    dispatch_request(loop, conn);
+}
+
+
+static void uring_resume_connections(EventLoop *loop, UringLoop *uring, const struct io_uring_cqe *cqe) {
+    Connection *conn = take_resumed_connections(loop);
+    while (conn) {
+        Connection *next = conn->next;
+        if (uring_submit_recv(uring, conn)) {
+            track_connection(loop, conn);
+        } else {
+            connection_close(conn);
+        }
+        conn = next;
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE) && !uring_submit_wakeup(uring, loop)) {
+        fprintf(stderr, "Failed to resubmit the wakeup poll\n");
+    }
+}
+
+
+// returns false without touching any connection when io_uring can't be used, so the caller can fall back to epoll
+static bool uring_loop_run(EventLoop *loop, volatile sig_atomic_t *running) {
+    UringLoop uring;
+    if (!ring_init(&uring.ring, URING_ENTRIES)) {
+        return false;
+    }
+    // provided buffer rings came with the same kernel release as multishot accept, so this doubles as the feature check
+    if (!buffer_ring_init(&uring.buffers, &uring.ring, URING_BUFFER_COUNT, URING_BUFFER_SIZE, URING_BUFFER_GROUP)) {
+        ring_exit(&uring.ring);
+        return false;
+    }
+    uring.tick = (struct __kernel_timespec) {.tv_sec = 1};
+    if (!uring_submit_accept(&uring, loop) || !uring_submit_wakeup(&uring, loop) ||
+        !uring_submit_timeout(&uring, loop)) {
+        buffer_ring_free(&uring.buffers);
+        ring_exit(&uring.ring);
+        return false;
+    }
+
+    while (*running) {
+        int result = ring_submit_and_wait(&uring.ring, 1);
+        if (result < 0 && result != -EINTR) {
+            fprintf(stderr, "io_uring_enter failed: %s\n", strerror(-result));
+            break;
+        }
+        loop->now = monotonic_seconds();
+
+        struct io_uring_cqe *next;
+        while ((next = ring_peek_cqe(&uring.ring))) {
+            struct io_uring_cqe cqe = *next;
+            ring_cqe_seen(&uring.ring);
+
+            void *target = (void *)(uintptr_t)(cqe.user_data & ~(uint64_t)URING_TAG_MASK);
+            switch (cqe.user_data & URING_TAG_MASK) {
+                case URING_RECV:
+                    uring_receive(loop, &uring, target, &cqe);
+                    break;
+                case URING_ACCEPT:
+                    uring_accept(loop, &uring, &cqe);
+                    break;
+                case URING_WAKEUP:
+                    uring_resume_connections(loop, &uring, &cqe);
+                    break;
+                case URING_TIMEOUT:
+                    uring_submit_timeout(&uring, loop);
+                    break;
+            }
+        }
+        close_idle_connections(loop, shutdown_connection);
+    }
+
+    // closing the ring cancels whatever is still in flight
+    ring_exit(&uring.ring);
+    buffer_ring_free(&uring.buffers);
+    return true;
+}
+#endif
+
+
+void event_loop_run(EventLoop *loop, volatile sig_atomic_t *running) {
+    // the loop only ever sends short error responses itself, a client too slow to take one at once loses it
+    response_never_wait();
+#ifdef USE_IO_URING
+    if (uring_loop_run(loop, running)) {
+        return;
+    }
+    fprintf(stderr, "io_uring is unavailable, falling back to epoll\n");
+#endif
+    struct epoll_event events[MAX_EVENTS];
+
+    while (*running) {
+        int ready = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, 1000);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            break;
+        }
+        loop->now = monotonic_seconds();
+
+        for (int i = 0; i < ready; ++i) {
+            if (events[i].data.ptr == loop) {
+                accept_connections(loop);
+            } else if (events[i].data.ptr == &loop->wakeup_fd) {
+                rearm_resumed_connections(loop);
+            } else {
+                handle_client_event(loop, events[i].data.ptr);
+            }
+        }
+        close_idle_connections(loop, connection_close);
+    }
+}
+
+
+void event_loop_cleanup(EventLoop *loop) {
+    IdleList *lists[2] = {&loop->waiting, &loop->idle};
+    for (int i = 0; i < 2; ++i) {
+        while (lists[i]->head) {
+            Connection *conn = lists[i]->head;
+            untrack_connection(loop, conn);
+            connection_close(conn);
+        }
+    }
+    while (loop->resumed) {
+        Connection *conn = loop->resumed;
+        loop->resumed = conn->next;
+        connection_close(conn);
+    }
+    close(loop->wakeup_fd);
+    close(loop->epoll_fd);
+    close(loop->server_socket);
+    pthread_mutex_destroy(&loop->resumed_mutex);
+}
\ No newline at end of file
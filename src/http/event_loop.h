@@ -0,0 +1,40 @@
+#ifndef HTTP_SERVER_EVENT_LOOP_H
+#define HTTP_SERVER_EVENT_LOOP_H
+
+#include "connection.h"
+#include <signal.h>
+#include <pthread.h>
+
+#define MAX_EVENTS 256
+
+
+// connections waiting on the client, oldest first, all held to the same timeout
+typedef struct {
+    Connection *head;
+    Connection *tail;
+    int timeout;
+} IdleList;
+
+struct EventLoop {
+    int epoll_fd;
+    int server_socket;
+    int wakeup_fd;
+    time_t now;
+    IdleList waiting;
+    IdleList idle;
+    Connection *resumed;
+    pthread_mutex_t resumed_mutex;
+    bool (*dispatch)(Connection *conn);
+};
+
+bool event_loop_init(EventLoop *loop, int server_socket, int request_timeout, int idle_timeout,
+                     bool (*dispatch)(Connection *conn));
+
+void event_loop_run(EventLoop *loop, volatile sig_atomic_t *running);
+
+void event_loop_resume(Connection *conn);
+
+void event_loop_cleanup(EventLoop *loop);
+
+
+#endif
@@ -0,0 +1,129 @@
+#include "headers.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define STATUS_LINE(code, text) [code] = {"HTTP/1.1 " #code " " text "\r\n", sizeof("HTTP/1.1 " #code " " text "\r\n") - 1}
+#define HEADER(literal) literal, sizeof(literal) - 1
+
+
+typedef struct {
+    const char *line;
+    size_t length;
+} StatusLine;
+
+// every status the server sends; anything else goes out as a 500
+static const StatusLine STATUS_LINES[600] = {
+        STATUS_LINE(200, "OK"),
+        STATUS_LINE(201, "Created"),
+        STATUS_LINE(204, "No Content"),
+        STATUS_LINE(206, "Partial Content"),
+        STATUS_LINE(303, "See Other"),
+        STATUS_LINE(304, "Not Modified"),
+        STATUS_LINE(400, "Bad Request"),
+        STATUS_LINE(401, "Unauthorized"),
+        STATUS_LINE(403, "Forbidden"),
+        STATUS_LINE(404, "Not Found"),
+        STATUS_LINE(405, "Method Not Allowed"),
+        STATUS_LINE(409, "Conflict"),
+        STATUS_LINE(413, "Content Too Large"),
+        STATUS_LINE(415, "Unsupported Media Type"),
+        STATUS_LINE(416, "Range Not Satisfiable"),
+        STATUS_LINE(429, "Too Many Requests"),
+        STATUS_LINE(500, "Internal Server Error"),
+        STATUS_LINE(501, "Not Implemented"),
+        STATUS_LINE(503, "Service Unavailable"),
+};
+
+// two copies, so the clock never rewrites the one responses are copying from
+static char date_headers[2][DATE_HEADER_LENGTH + 1];
+static int current_date = 0;
+
+
+static void update_date_header() {
+    int next = !__atomic_load_n(&current_date, __ATOMIC_RELAXED);
+    time_t now = time(NULL);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    strftime(date_headers[next], sizeof(date_headers[next]), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+    __atomic_store_n(&current_date, next, __ATOMIC_RELEASE);
+}
+
+
+// wakes up on every second boundary, so the header is never more than a few milliseconds behind
+static void *date_clock(void *arg) {
+    (void)arg;
+    while (1) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        struct timespec wait = {0, 1000000000 - now.tv_nsec};
+        nanosleep(&wait, NULL);
+        update_date_header();
+    }
+    return NULL;
+}
+
+
+bool headers_init() {
+    update_date_header();
+    pthread_t clock_thread;
+    if (pthread_create(&clock_thread, NULL, date_clock, NULL) != 0) {
+        perror("Failed to create the date clock thread");
+        return false;
+    }
+    pthread_detach(clock_thread);
+    return true;
+}
+
+
+// the Date line of a block from format_header_block starts right after its status line
+void copy_date_header(char *destination) {
+    memcpy(destination, date_headers[__atomic_load_n(&current_date, __ATOMIC_ACQUIRE)], DATE_HEADER_LENGTH);
+}
+
+
+static char *append(char *p, const char *data, size_t length) {
+    memcpy(p, data, length);
+    return p + length;
+}
+
+
+// buffer has to hold HEADER_BLOCK_SIZE bytes; 0 if other doesn't fit in it, since a response missing some of its
+// headers could be wrong in ways the client can't tell
+size_t format_header_block(char *buffer, int status_code, const char *content_type, bool keep_alive,
+                           const char *other) {
+    if (status_code < 0 || status_code >= 600 || !STATUS_LINES[status_code].line) {
+        status_code = 500;
+    }
+    const StatusLine *status = &STATUS_LINES[status_code];
+    char *p = append(buffer, status->line, status->length);
+    copy_date_header(p);
+    p += DATE_HEADER_LENGTH;
+    p = append(p, HEADER("Server: " SERVER_NAME "\r\n"));
+    if (content_type) {
+        p = append(p, HEADER("Content-Type: "));
+        p = append(p, content_type, strlen(content_type));
+        p = append(p, HEADER("\r\n"));
+    }
+    if (keep_alive) {
+        p = append(p, HEADER("Connection: keep-alive\r\n"));
+    } else {
+        p = append(p, HEADER("Connection: close\r\n"));
+    }
+    // responses without a content type carry no body, which persistent connections need spelled out;
+    // a 304's Content-Length would describe the body it stands in for, so it gets none
+    if (!content_type && status_code != 204 && status_code != 304) {
+        p = append(p, HEADER("Content-Length: 0\r\n"));
+    }
+    if (other) {
+        size_t other_length = strlen(other);
+        if ((size_t)(p - buffer) + other_length + 2 > HEADER_BLOCK_SIZE) {
+            fprintf(stderr, "%zu bytes of headers don't fit in the header block\n", other_length);
+            return 0;
+        }
+        p = append(p, other, other_length);
+    }
+    p = append(p, HEADER("\r\n"));
+    return p - buffer;
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#ifndef HTTP_SERVER_HEADERS_H
+#define HTTP_SERVER_HEADERS_H
+
+#include <stddef.h>
+
+#define HEADER_BLOCK_SIZE 1024
+#define SERVER_NAME "HTTP_server"
+#define DATE_HEADER_LENGTH (sizeof("Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n") - 1)
+
+
+bool headers_init();
+
+void copy_date_header(char *destination);
+
+size_t format_header_block(char *buffer, int status_code, const char *content_type, bool keep_alive,
+                           const char *other);
+
+
+#endif
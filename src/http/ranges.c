@@ -0,0 +1,130 @@
+#include "ranges.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#define MAX_POSITION_DIGITS 18
+
+
+static unsigned long long boundary_counter = 0;
+
+
+static bool parse_position(const char **p, const char *end, off_t *position) {
+    const char *start = *p;
+    off_t value = 0;
+    while (*p < end && **p >= '0' && **p <= '9' && *p - start < MAX_POSITION_DIGITS) {
+        value = value * 10 + (**p - '0');
+        (*p)++;
+    }
+    *position = value;
+    return *p > start && (*p == end || **p < '0' || **p > '9');
+}
+
+
+// a Range only applies to the representation it was computed against; an entity tag has to match strongly
+static bool if_range_matches(const HttpRequest *request, const Validators *validators) {
+    Slice if_range = request_header(request, HDR_IF_RANGE);
+    if (!if_range.ptr) {
+        return true;
+    }
+    if (if_range.len > 0 && if_range.ptr[0] == '"') {
+        return if_range.len == validators->etag_length && memcmp(if_range.ptr, validators->etag, if_range.len) == 0;
+    }
+    time_t date;
+    return parse_http_date(if_range, &date) && date == validators->last_modified;
+}
+
+
+// RANGE_NONE means the whole representation should be sent: no Range, one we can't parse, one asking for more
+// bytes than there are (overlapping ranges), or one with more than MAX_RANGES parts
+RangeStatus request_ranges(const HttpRequest *request, const Validators *validators, off_t size, ByteRange *ranges,
+                           int *count) {
+    Slice header = request ? request_header(request, HDR_RANGE) : (Slice) {NULL, 0};
+    if (!header.ptr || header.len < 6 || strncasecmp(header.ptr, "bytes=", 6) != 0 ||
+        !if_range_matches(request, validators)) {
+        return RANGE_NONE;
+    }
+
+    const char *p = header.ptr + 6;
+    const char *end = header.ptr + header.len;
+    bool any_specified = false;
+    off_t total = 0;
+    *count = 0;
+    while (p < end) {
+        if (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+            continue;
+        }
+        off_t first, last;
+        bool suffix = *p == '-';
+        if (suffix) {
+            p++;
+            if (!parse_position(&p, end, &last)) {
+                return RANGE_NONE;
+            }
+            first = last >= size ? 0 : size - last;
+            last = size - 1;
+        } else {
+            if (!parse_position(&p, end, &first) || p == end || *p != '-') {
+                return RANGE_NONE;
+            }
+            p++;
+            if (p < end && *p >= '0' && *p <= '9') {
+                if (!parse_position(&p, end, &last) || last < first) {
+                    return RANGE_NONE;
+                }
+            } else {
+                last = size - 1;
+            }
+        }
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        if (p < end && *p != ',') {
+            return RANGE_NONE;
+        }
+        any_specified = true;
+
+        // past the end, or an empty suffix; the other ranges may still be satisfiable
+        if (first >= size || last < first) {
+            continue;
+        }
+        if (last >= size) {
+            last = size - 1;
+        }
+        if (*count == MAX_RANGES) {
+            return RANGE_NONE;
+        }
+        total += last + 1 - first;
+        if (total > size) {
+            return RANGE_NONE;
+        }
+        ranges[(*count)++] = (ByteRange) {first, last + 1};
+    }
+    if (!any_specified) {
+        return RANGE_NONE;
+    }
+    return *count > 0 ? RANGE_SATISFIABLE : RANGE_UNSATISFIABLE;
+}
+
+
+void multipart_init(Multipart *multipart, const char *content_type, off_t size, const ByteRange *ranges, int count) {
+    char boundary[MULTIPART_BOUNDARY_SIZE];
+    snprintf(boundary, sizeof(boundary), "%010llx%010llx", (unsigned long long)time(NULL),
+             __atomic_add_fetch(&boundary_counter, 1, __ATOMIC_RELAXED));
+    snprintf(multipart->content_type, sizeof(multipart->content_type), "multipart/byteranges; boundary=%s",
+             boundary);
+
+    multipart->content_length = 0;
+    for (int i = 0; i < count; ++i) {
+        multipart->part_header_lengths[i] = snprintf(multipart->part_headers[i], MULTIPART_PART_HEADER_SIZE,
+                                                     "\r\n--%s\r\nContent-Type: %s\r\n"
+                                                     "Content-Range: bytes %lld-%lld/%lld\r\n\r\n",
+                                                     boundary, content_type, (long long)ranges[i].start,
+                                                     (long long)ranges[i].end - 1, (long long)size);
+        multipart->content_length += multipart->part_header_lengths[i] + (ranges[i].end - ranges[i].start);
+    }
+    multipart->trailer_length = snprintf(multipart->trailer, sizeof(multipart->trailer), "\r\n--%s--\r\n", boundary);
+    multipart->content_length += multipart->trailer_length;
+}
\ No newline at end of file
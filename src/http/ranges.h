@@ -0,0 +1,40 @@
+#ifndef HTTP_SERVER_RANGES_H
+#define HTTP_SERVER_RANGES_H
+
+#include "validators.h"
+#include <sys/types.h>
+
+#define MAX_RANGES 16
+#define MULTIPART_PART_HEADER_SIZE 192
+#define MULTIPART_BOUNDARY_SIZE 32
+
+
+// [start, end) of a representation
+typedef struct {
+    off_t start;
+    off_t end;
+} ByteRange;
+
+typedef enum {
+    RANGE_NONE,
+    RANGE_SATISFIABLE,
+    RANGE_UNSATISFIABLE,
+} RangeStatus;
+
+// everything around the parts of a multipart/byteranges body, formatted up front so its length is known
+typedef struct {
+    char content_type[128];
+    char part_headers[MAX_RANGES][MULTIPART_PART_HEADER_SIZE];
+    size_t part_header_lengths[MAX_RANGES];
+    char trailer[MULTIPART_BOUNDARY_SIZE + 8];
+    size_t trailer_length;
+    size_t content_length;
+} Multipart;
+
+RangeStatus request_ranges(const HttpRequest *request, const Validators *validators, off_t size, ByteRange *ranges,
+                           int *count);
+
+void multipart_init(Multipart *multipart, const char *content_type, off_t size, const ByteRange *ranges, int count);
+
+
+#endif
@@ -1,102 +1,384 @@
 #include "request.h"
+#include "tokenizer.h"
 #include <string.h>
-#include <stdio.h>
-#include <stdlib.h>
+#include <strings.h>
+#include <stdint.h>
 
 
-static int convert_method_str(const char *method) {
-    if (strcmp(method, "GET") == 0) {
+static int convert_method_str(const char *method, size_t length) {
+    if (length == 3 && memcmp(method, "GET", 3) == 0) {
         return GET;
-    } else if (strcmp(method, "POST") == 0) {
+    } else if (length == 4 && memcmp(method, "POST", 4) == 0) {
         return POST;
-    } else if (strcmp(method, "DELETE") == 0) {
+    } else if (length == 6 && memcmp(method, "DELETE", 6) == 0) {
         return DELETE;
-    } else if (strcmp(method, "PATCH") == 0) {
+    } else if (length == 5 && memcmp(method, "PATCH", 5) == 0) {
         return PATCH;
     }
     return -1;
 }
 
 
-RequestParsingStatus parse_http_request(char *buffer, HttpRequest *request) {
-    char *req_line_end = strstr(buffer, "\r\n");
-    if (!req_line_end) {
-        return REQ_PARSE_INVALID_FORMAT;
+void request_parser_reset(RequestParser *parser) {
+    memset(parser, 0, sizeof(RequestParser));
+}
+
+
+// strict decimal, so a malformed length can't desync the framing of pipelined requests
+static bool parse_content_length(const char *value, const char *end, size_t *content_length) {
+    while (value < end && (*value == ' ' || *value == '\t')) value++;
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t')) end--;
+    if (value == end) {
+        return false;
     }
-    *req_line_end = '\0';
 
-    char *method_str = strtok(buffer, " ");
-    char *path = strtok(NULL, " ");
-    char *protocol = strtok(NULL, " ");
-    char *query_string_path = strtok(path, "?");
-    char *query_string = NULL;
-    if (query_string_path) {
-        path = query_string_path;
-        query_string = strtok(NULL, "\r");
+    size_t length = 0;
+    for (; value < end; ++value) {
+        if (*value < '0' || *value > '9' || length > (SIZE_MAX - 9) / 10) {
+            return false;
+        }
+        length = length * 10 + (*value - '0');
     }
-    if (!method_str || !path || !protocol) {
-        return REQ_PARSE_INVALID_FORMAT;
+    *content_length = length;
+    return true;
+}
+
+
+static const char *KNOWN_HEADERS[HDR_KNOWN_COUNT] = {
+        [HDR_HOST] = "Host",
+        [HDR_CONNECTION] = "Connection",
+        [HDR_CONTENT_LENGTH] = "Content-Length",
+        [HDR_CONTENT_TYPE] = "Content-Type",
+        [HDR_COOKIE] = "Cookie",
+        [HDR_X_CSRF_TOKEN] = "X-CSRF-Token",
+        [HDR_ACCEPT_ENCODING] = "Accept-Encoding",
+        [HDR_IF_NONE_MATCH] = "If-None-Match",
+        [HDR_IF_MODIFIED_SINCE] = "If-Modified-Since",
+        [HDR_RANGE] = "Range",
+        [HDR_IF_RANGE] = "If-Range",
+        [HDR_TRANSFER_ENCODING] = "Transfer-Encoding",
+};
+
+// slots of the perfect hash below, -1 where no known header lands
+static const int KNOWN_HEADER_SLOTS[16] = {
+        HDR_IF_RANGE, HDR_IF_NONE_MATCH, -1, HDR_TRANSFER_ENCODING,
+        HDR_CONNECTION, HDR_IF_MODIFIED_SINCE, HDR_ACCEPT_ENCODING, HDR_CONTENT_TYPE,
+        -1, HDR_X_CSRF_TOKEN, HDR_COOKIE, -1,
+        -1, HDR_CONTENT_LENGTH, HDR_RANGE, HDR_HOST,
+};
+
+
+// collision-free for the known header names; the case bit is folded so the lookup is case-insensitive
+static int known_header(const char *name, size_t length) {
+    if (length < 2) {
+        return -1;
+    }
+    unsigned hash = (length + 9 * (name[0] | 0x20) + (name[length - 2] | 0x20)) & 15;
+    int header = KNOWN_HEADER_SLOTS[hash];
+    if (header == -1 || strlen(KNOWN_HEADERS[header]) != length ||
+        strncasecmp(name, KNOWN_HEADERS[header], length) != 0) {
+        return -1;
     }
+    return header;
+}
 
-    if (strlen(method_str) >= 8 ||
-        strlen(path) >= sizeof(request->path) ||
-        path[0] != '/' ||
-        strlen(protocol) >= sizeof(request->protocol) ||
-        strncmp(protocol, "HTTP/", 5) != 0) {
-        return REQ_PARSE_INVALID_FORMAT;
+
+// a few case-folded bytes rather than the whole name, since collisions only cost a probe
+static unsigned other_header_hash(const char *name, size_t length) {
+    unsigned hash = length * 7 + 3 * (name[0] | 0x20) + (name[length / 2] | 0x20) + 5 * (name[length - 1] | 0x20);
+    return hash & (MAX_OTHER_HEADERS - 1);
+}
+
+
+static void index_other_header(HeaderIndex *index, const char *data, HeaderSpan name, HeaderSpan value) {
+    // past three quarters full, the rest of the headers nobody asks for by name are left out of the index
+    if (index->other_count >= MAX_OTHER_HEADERS * 3 / 4) {
+        return;
+    }
+    unsigned slot = other_header_hash(data + name.offset, name.length);
+    while (index->other_names[slot].offset != 0) {
+        if (index->other_names[slot].length == name.length &&
+            strncasecmp(data + index->other_names[slot].offset, data + name.offset, name.length) == 0) {
+            return;
+        }
+        slot = (slot + 1) & (MAX_OTHER_HEADERS - 1);
+    }
+    index->other_names[slot] = name;
+    index->other_values[slot] = value;
+    index->other_count++;
+}
+
+
+// a rejected request is never framed past its headers, so whatever it sent after them can't pass for the next request
+static void reject_request(RequestParser *parser, RequestParsingStatus error) {
+    parser->state = PARSER_INVALID;
+    parser->error = error;
+}
+
+
+// the first occurrence of a header is the one that gets indexed
+static bool parse_header_line(RequestParser *parser, const char *data, const char *line, size_t length,
+                              const char *colon) {
+    if (!colon || colon == line || colon[-1] == ' ' || colon[-1] == '\t') {
+        return false;
+    }
+    const char *value = colon + 1;
+    const char *value_end = line + length;
+    while (value < value_end && (*value == ' ' || *value == '\t')) value++;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) value_end--;
+
+    HeaderSpan name_span = {line - data, colon - line};
+    HeaderSpan value_span = {value - data, value_end - value};
+    int header = known_header(line, name_span.length);
+    if (header == -1) {
+        index_other_header(&parser->headers, data, name_span, value_span);
+        return true;
+    }
+
+    bool repeated = parser->headers.known[header].offset != 0;
+    if (header == HDR_CONTENT_LENGTH) {
+        // differing lengths would let the request be framed two ways
+        size_t content_length;
+        if (!parse_content_length(value, value_end, &content_length) ||
+            (repeated && content_length != parser->content_length)) {
+            return false;
+        }
+        // refused before any of the body is read, the receive buffer grows to fit whatever length is announced
+        if (content_length > MAX_BODY_SIZE) {
+            reject_request(parser, REQ_PARSE_BODY_TOO_LARGE);
+            return true;
+        }
+        parser->content_length = content_length;
+    }
+    if (!repeated) {
+        parser->headers.known[header] = value_span;
+    }
+    return true;
+}
+
+
+// the body is framed by Content-Length alone; a chunked body read as none would have its chunks served as requests
+static void end_headers(RequestParser *parser, size_t end) {
+    if (parser->headers.known[HDR_TRANSFER_ENCODING].offset != 0) {
+        reject_request(parser, parser->headers.known[HDR_CONTENT_LENGTH].offset != 0
+                               ? REQ_PARSE_INVALID_FORMAT : REQ_PARSE_UNSUPPORTED_TRANSFER_ENCODING);
+        return;
     }
-    Method method = convert_method_str(method_str);
-    request->method = method;
-    strcpy(request->path, path);
-    if (query_string) request->query_string = strdup(query_string);
-    strcpy(request->protocol, protocol);
-
-    *req_line_end = '\r';
-    req_line_end += 2;
-    char *headers_end = strstr(req_line_end, "\r\n\r\n");
-    if (headers_end) {
-        *headers_end = '\0';
-
-        size_t headers_length = headers_end - req_line_end;
-        request->headers = malloc(headers_length + 1);
-        if (!request->headers) {
-            perror("Failed to allocate memory for request headers");
-            if (request->query_string) free(request->query_string);
-            return REQ_PARSE_MEMORY_FAILURE;
+    parser->headers_length = end + 1;
+    parser->state = PARSER_BODY;
+}
+
+
+static void parse_line(RequestParser *parser, const char *data, size_t end) {
+    if (end == parser->line_start || data[end - 1] != '\r' || end >= MAX_HEADER_SIZE) {
+        parser->state = PARSER_INVALID;
+        return;
+    }
+    const char *line = data + parser->line_start;
+    size_t line_length = end - 1 - parser->line_start;
+    const char *colon = parser->colon ? data + parser->colon : NULL;
+    parser->line_start = end + 1;
+    parser->colon = 0;
+
+    if (parser->state == PARSER_REQUEST_LINE) {
+        if (line_length == 0) {
+            parser->state = PARSER_INVALID;
+            return;
         }
-        strcpy(request->headers, req_line_end);
-
-        headers_end += 4;
-        size_t body_length = strlen(headers_end);
-        if (body_length == 0) {
-            request->body = NULL;
-        } else {
-            request->body = malloc(body_length + 1);
-            if (!request->body) {
-                if (request->query_string) free(request->query_string);
-                perror("Failed to allocate memory for request body");
-                return REQ_PARSE_MEMORY_FAILURE;
+        parser->request_line_length = line_length;
+        parser->state = PARSER_HEADERS;
+    } else if (line_length == 0) {
+        end_headers(parser, end);
+    } else if (!parse_header_line(parser, data, line, line_length, colon)) {
+        reject_request(parser, REQ_PARSE_INVALID_FORMAT);
+    }
+}
+
+
+// without vector instructions, libc's memchr gets through a line faster than classifying it in words does
+static void feed_lines(RequestParser *parser, const char *data, size_t length) {
+    while ((parser->state == PARSER_REQUEST_LINE || parser->state == PARSER_HEADERS) && parser->scanned < length) {
+        const char *line_end = memchr(data + parser->scanned, '\n', length - parser->scanned);
+        if (!line_end) {
+            parser->scanned = length;
+            return;
+        }
+        size_t end = line_end - data;
+        if (parser->state == PARSER_HEADERS) {
+            const char *colon = memchr(data + parser->line_start, ':', end - parser->line_start);
+            parser->colon = colon ? (size_t)(colon - data) : 0;
+        }
+        parser->scanned = end + 1;
+        parse_line(parser, data, end);
+    }
+}
+
+
+// the input is classified 64 bytes at a time, and every line ending in a block is handled from its bitmasks
+static void classify_lines(RequestParser *parser, const char *data, size_t length) {
+    while ((parser->state == PARSER_REQUEST_LINE || parser->state == PARSER_HEADERS) && parser->scanned < length) {
+        size_t block = parser->scanned;
+        size_t block_length = length - block < 64 ? length - block : 64;
+        uint64_t newlines, colons;
+        tokenizer_classify(data + block, block_length, '\n', ':', &newlines, &colons);
+
+        while (newlines && (parser->state == PARSER_REQUEST_LINE || parser->state == PARSER_HEADERS)) {
+            uint64_t before = (newlines & -newlines) - 1;
+            if (parser->state == PARSER_HEADERS && parser->colon == 0 && (colons & before)) {
+                parser->colon = block + __builtin_ctzll(colons & before);
             }
-            strcpy(request->body, headers_end);
+            colons &= ~before;
+            size_t end = block + __builtin_ctzll(newlines);
+            newlines &= newlines - 1;
+            parser->scanned = end + 1;
+            parse_line(parser, data, end);
         }
-    } else {
-        if (!strstr(req_line_end, "\r\n")) {
-            return REQ_PARSE_INVALID_FORMAT;
+        if (parser->state == PARSER_REQUEST_LINE || parser->state == PARSER_HEADERS) {
+            if (parser->state == PARSER_HEADERS && parser->colon == 0 && colons) {
+                parser->colon = block + __builtin_ctzll(colons);
+            }
+            parser->scanned = block + block_length;
         }
-        request->headers = NULL;
     }
+}
+
+
+// picks up where the previous call stopped; data always points at the start of the request
+RequestParsingStatus request_parser_feed(RequestParser *parser, const char *data, size_t length) {
+    if (tokenizer_level() == TOKENIZER_SCALAR) {
+        feed_lines(parser, data, length);
+    } else {
+        classify_lines(parser, data, length);
+    }
+    if ((parser->state == PARSER_REQUEST_LINE || parser->state == PARSER_HEADERS) && length > MAX_HEADER_SIZE) {
+        parser->state = PARSER_INVALID;
+    }
+
+    if (parser->state == PARSER_BODY && length - parser->headers_length >= parser->content_length) {
+        parser->state = PARSER_COMPLETE;
+    }
+
+    if (parser->state == PARSER_COMPLETE) {
+        return REQ_PARSE_SUCCESS;
+    } else if (parser->state == PARSER_INVALID) {
+        return parser->error != REQ_PARSE_SUCCESS ? parser->error : REQ_PARSE_INVALID_FORMAT;
+    }
+    return REQ_PARSE_INCOMPLETE;
+}
+
+
+size_t request_parser_length(const RequestParser *parser) {
+    return parser->headers_length + parser->content_length;
+}
+
+
+// buffer holds the complete request the parser framed
+RequestParsingStatus parse_http_request(const char *buffer, const RequestParser *parser, HttpRequest *request) {
+    if (parser->state == PARSER_INVALID && parser->error != REQ_PARSE_SUCCESS) {
+        return parser->error;
+    } else if (parser->state != PARSER_COMPLETE) {
+        return REQ_PARSE_INVALID_FORMAT;
+    }
+    const char *line_end = buffer + parser->request_line_length;
+
+    const char *method_str = buffer;
+    const char *method_end = tokenizer_find(method_str, line_end, ' ', ' ');
+    if (!method_end) {
+        return REQ_PARSE_INVALID_FORMAT;
+    }
+    const char *target = method_end + 1;
+    while (target < line_end && *target == ' ') target++;
+    const char *path_end = tokenizer_find(target, line_end, ' ', '?');
+    if (!path_end) {
+        return REQ_PARSE_INVALID_FORMAT;
+    }
+    const char *target_end = *path_end == '?' ? tokenizer_find(path_end, line_end, ' ', ' ') : path_end;
+    if (!target_end) {
+        return REQ_PARSE_INVALID_FORMAT;
+    }
+    const char *protocol = target_end + 1;
+    while (protocol < line_end && *protocol == ' ') protocol++;
+    const char *protocol_end = tokenizer_find(protocol, line_end, ' ', ' ');
+    if (!protocol_end) {
+        protocol_end = line_end;
+    }
+
+    size_t method_length = method_end - method_str;
+    size_t path_length = path_end - target;
+    size_t protocol_length = protocol_end - protocol;
+    if (method_length >= 8 ||
+        path_length == 0 ||
+        path_length >= MAX_URL_PATH_LENGTH ||
+        target[0] != '/' ||
+        protocol_length >= 16 ||
+        protocol_length < 5 ||
+        strncmp(protocol, "HTTP/", 5) != 0) {
+        return REQ_PARSE_INVALID_FORMAT;
+    }
+
+    request->method = convert_method_str(method_str, method_length);
+    request->path = (Slice) {target, path_length};
+    request->protocol = (Slice) {protocol, protocol_length};
+    if (path_end < target_end) {
+        request->query_string = (Slice) {path_end + 1, target_end - path_end - 1};
+    }
+    request->body = (Slice) {buffer + parser->headers_length, parser->content_length};
+    request->start = buffer;
+    request->headers = &parser->headers;
     return REQ_PARSE_SUCCESS;
 }
 
 
-void free_http_request(HttpRequest *request) {
-    if (request->query_string) {
-        free(request->query_string);
+static bool has_token(const char *value, size_t value_length, const char *token) {
+    size_t token_length = strlen(token);
+    const char *end = value + value_length;
+    while (value < end) {
+        while (value < end && (*value == ' ' || *value == '\t' || *value == ',')) value++;
+        const char *token_end = value;
+        while (token_end < end && *token_end != ',') token_end++;
+        size_t length = token_end - value;
+        while (length > 0 && (value[length - 1] == ' ' || value[length - 1] == '\t')) length--;
+        if (length == token_length && strncasecmp(value, token, token_length) == 0) {
+            return true;
+        }
+        value = token_end;
     }
-    if (request->headers) {
-        free(request->headers);
+    return false;
+}
+
+
+Slice request_header(const HttpRequest *request, HeaderName name) {
+    HeaderSpan span = request->headers->known[name];
+    return (Slice) {span.offset ? request->start + span.offset : NULL, span.length};
+}
+
+
+Slice request_header_named(const HttpRequest *request, const char *name) {
+    size_t length = strlen(name);
+    int header = known_header(name, length);
+    if (header != -1) {
+        return request_header(request, header);
     }
-    if (request->body) {
-        free(request->body);
+
+    const HeaderIndex *index = request->headers;
+    unsigned slot = other_header_hash(name, length);
+    while (index->other_names[slot].offset != 0) {
+        HeaderSpan other = index->other_names[slot];
+        if (other.length == length && strncasecmp(request->start + other.offset, name, length) == 0) {
+            HeaderSpan value = index->other_values[slot];
+            return (Slice) {request->start + value.offset, value.length};
+        }
+        slot = (slot + 1) & (MAX_OTHER_HEADERS - 1);
+    }
+    return (Slice) {NULL, 0};
+}
+
+
+// HTTP/1.1 connections persist unless the client says otherwise, HTTP/1.0 ones only when asked to
+bool request_wants_keep_alive(const HttpRequest *request) {
+    Slice connection = request_header(request, HDR_CONNECTION);
+    if (has_token(connection.ptr, connection.len, "close")) {
+        return false;
     }
+    return slice_equals(request->protocol, "HTTP/1.1") || has_token(connection.ptr, connection.len, "keep-alive");
 }
\ No newline at end of file
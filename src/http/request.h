@@ -1,6 +1,13 @@
 #ifndef HTTP_SERVER_REQUEST_H
 #define HTTP_SERVER_REQUEST_H
 
+#include "util/slice.h"
+#include <stddef.h>
+
+#define MAX_HEADER_SIZE 65536
+#define MAX_BODY_SIZE (1 << 20)
+#define MAX_URL_PATH_LENGTH 256
+#define MAX_OTHER_HEADERS 32
 
 typedef enum {
     GET,
@@ -9,24 +16,91 @@ typedef enum {
     PATCH
 } Method;
 
+typedef enum {
+    HDR_HOST,
+    HDR_CONNECTION,
+    HDR_CONTENT_LENGTH,
+    HDR_CONTENT_TYPE,
+    HDR_COOKIE,
+    HDR_X_CSRF_TOKEN,
+    HDR_ACCEPT_ENCODING,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_RANGE,
+    HDR_IF_RANGE,
+    HDR_TRANSFER_ENCODING,
+    HDR_KNOWN_COUNT,
+} HeaderName;
+
+// offsets from the start of the request, so the index stays valid when the buffer moves between reads;
+// an offset of 0 means the header is absent, as that's always where the request line is
 typedef struct {
-    Method method;
-    char *query_string;
-    char path[256];
-    char protocol[16];
-    char *headers;
-    char *body;
-} HttpRequest;
+    unsigned offset;
+    unsigned length;
+} HeaderSpan;
+
+// values of well-known headers by name, every other header in a small open-addressing map keyed by its name
+typedef struct {
+    HeaderSpan known[HDR_KNOWN_COUNT];
+    HeaderSpan other_names[MAX_OTHER_HEADERS];
+    HeaderSpan other_values[MAX_OTHER_HEADERS];
+    int other_count;
+} HeaderIndex;
 
 typedef enum {
     REQ_PARSE_SUCCESS,
     REQ_PARSE_MEMORY_FAILURE,
     REQ_PARSE_INVALID_FORMAT,
+    REQ_PARSE_INCOMPLETE,
+    REQ_PARSE_UNSUPPORTED_TRANSFER_ENCODING,
+    REQ_PARSE_BODY_TOO_LARGE,
 } RequestParsingStatus;
 
-RequestParsingStatus parse_http_request(char *buffer, HttpRequest *request);
+typedef enum {
+    PARSER_REQUEST_LINE,
+    PARSER_HEADERS,
+    PARSER_BODY,
+    PARSER_COMPLETE,
+    PARSER_INVALID,
+} ParserState;
+
+// framing state of one request, kept across reads so every received byte is only scanned once
+typedef struct {
+    ParserState state;
+    size_t scanned;
+    size_t line_start;
+    size_t colon;
+    size_t request_line_length;
+    size_t headers_length;
+    size_t content_length;
+    RequestParsingStatus error;
+    HeaderIndex headers;
+} RequestParser;
+
+// every field points into the connection's receive buffer, which stays put until the request is answered
+typedef struct {
+    Method method;
+    Slice query_string;
+    Slice path;
+    Slice protocol;
+    Slice body;
+    const char *start;
+    const HeaderIndex *headers;
+} HttpRequest;
+
+void request_parser_reset(RequestParser *parser);
+
+RequestParsingStatus request_parser_feed(RequestParser *parser, const char *data, size_t length);
+
+size_t request_parser_length(const RequestParser *parser);
+
+RequestParsingStatus parse_http_request(const char *buffer, const RequestParser *parser, HttpRequest *request);
+
+Slice request_header(const HttpRequest *request, HeaderName name);
+
+Slice request_header_named(const HttpRequest *request, const char *name);
 
-void free_http_request(HttpRequest *request);
+bool request_wants_keep_alive(const HttpRequest *request);
 
 
 #endif
@@ -1,17 +1,43 @@
+#define _GNU_SOURCE
+
 #include "response.h"
+#include "connection.h"
+#include "headers.h"
+#include "static_cache.h"
+#include "validators.h"
+#include "compression.h"
+#include "ranges.h"
+#include "error_responses.h"
 #include <arpa/inet.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <linux/sockios.h>
+
+#ifdef USE_IO_URING
+#include "util/uring.h"
+#include <stdint.h>
+
+#define URING_FILE_ENTRIES 16
+#define URING_FILE_CHUNKS 4
+#define URING_FILE_CHUNK_SIZE 16384
+#endif
 
 #define MAX_PATH_LENGTH 256
-#define MAX_ERROR_JSON_LENGTH 512
+#define SEND_TIMEOUT_MS 30000
+#define SPLICE_CHUNK_SIZE 65536
 #define DOCUMENT_ROOT "../src/http/www"
 
 
-static const char *get_content_type(const char *path) {
+const char *get_content_type(const char *path) {
     const char *extension = strrchr(path, '.');
     if (extension == NULL) return "application/octet-stream";
     if (strcmp(extension, ".html") == 0 || strcmp(extension, ".htm") == 0) return "text/html";
@@ -24,143 +50,923 @@ static const char *get_content_type(const char *path) {
 }
 
 
+// a response that couldn't be sent in full leaves the connection out of step with the client
+static void abandon_connection(int client_socket) {
+    Connection *conn = connection_find(client_socket);
+    if (conn) {
+        conn->keep_alive = false;
+    }
+}
+
+
+// set on the event loop threads, where waiting for one client would hold up every other connection of the loop
+static _Thread_local bool never_wait = false;
+
+
+// sends from the calling thread fail as soon as the socket buffer is full, and the connection is dropped
+void response_never_wait() {
+    never_wait = true;
+}
+
+
+// a client that's still reading, however slowly, keeps the wait going; the socket only polls writable once a good
+// part of its buffer is free, so only a client that took nothing at all for SEND_TIMEOUT_MS is given up on
+static bool wait_until_writable(int client_socket) {
+    if (never_wait) {
+        return false;
+    }
+    int queued;
+    if (ioctl(client_socket, SIOCOUTQ, &queued) != 0) {
+        queued = -1;
+    }
+    struct pollfd pfd = {.fd = client_socket, .events = POLLOUT};
+    int ready;
+    while ((ready = poll(&pfd, 1, SEND_TIMEOUT_MS)) == 0) {
+        int still_queued;
+        if (queued < 0 || ioctl(client_socket, SIOCOUTQ, &still_queued) != 0 || still_queued >= queued) {
+            return false;
+        }
+        queued = still_queued;
+    }
+    return ready > 0;
+}
+
+
+// picks up after short writes, and waits out a full send buffer instead of dropping the rest of the response
+static bool send_vectors(int client_socket, struct iovec *vectors, int count, int flags) {
+    while (count > 0 && vectors->iov_len == 0) {
+        vectors++;
+        count--;
+    }
+    while (count > 0) {
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = vectors;
+        message.msg_iovlen = count;
+        ssize_t sent = sendmsg(client_socket, &message, flags | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_until_writable(client_socket)) {
+                continue;
+            }
+            abandon_connection(client_socket);
+            return false;
+        }
+        while (count > 0 && (size_t)sent >= vectors->iov_len) {
+            sent -= vectors->iov_len;
+            vectors++;
+            count--;
+        }
+        if (count > 0) {
+            vectors->iov_base = (char *)vectors->iov_base + sent;
+            vectors->iov_len -= sent;
+        }
+    }
+    return true;
+}
+
+
+static bool send_all(int client_socket, const void *data, size_t length, int flags) {
+    struct iovec vector = {.iov_base = (void *)data, .iov_len = length};
+    return send_vectors(client_socket, &vector, 1, flags);
+}
+
+
+// the stored response around a fresh Date line, in one sendmsg
+static void send_preformatted(int client_socket, const PreformattedResponse *response) {
+    char date_header[DATE_HEADER_LENGTH];
+    copy_date_header(date_header);
+    size_t rest = response->date_offset + DATE_HEADER_LENGTH;
+    struct iovec vectors[3] = {
+            {.iov_base = response->data, .iov_len = response->date_offset},
+            {.iov_base = date_header, .iov_len = DATE_HEADER_LENGTH},
+            {.iov_base = response->data + rest, .iov_len = response->length - rest},
+    };
+    send_vectors(client_socket, vectors, 3, 0);
+}
+
+
+// 0 if the headers don't fit in a block; the client has been sent a 500 instead and the connection is closing, so
+// the caller has to drop the response
+static int format_headers(char *response_header, int client_socket, int status_code, const char *content_type,
+                          const char *other) {
+    const Connection *conn = connection_find(client_socket);
+    size_t length = format_header_block(response_header, status_code, content_type, conn && conn->keep_alive, other);
+    if (length == 0) {
+        abandon_connection(client_socket);
+        send_preformatted(client_socket, error_page(500, false));
+    }
+    return (int)length;
+}
+
+
 void send_headers(int client_socket, int status_code, const char *content_type, const char *other) {
-    char response_header[1024];
-    char content_type_h[64] = "";
-    if (content_type) {
-        snprintf(content_type_h, sizeof(content_type_h), "Content-Type: %s\r\n", content_type);
+    char response_header[HEADER_BLOCK_SIZE];
+    int length = format_headers(response_header, client_socket, status_code, content_type, other);
+    if (length > 0) {
+        send_all(client_socket, response_header, length, 0);
     }
-    if (!other) other = "";
+}
 
-    const char *status_text;
-    switch (status_code) {
-        case 200:
-            status_text = "OK";
-            break;
-        case 201:
-            status_text = "Created";
-            break;
-        case 204:
-            status_text = "No Content";
-            break;
-        case 303:
-            status_text = "See Other";
-            break;
-        case 400:
-            status_text = "Bad Request";
-            break;
-        case 401:
-            status_text = "Unauthorized";
-            break;
-        case 404:
-            status_text = "Not Found";
-            break;
-        case 405:
-            status_text = "Method Not Allowed";
-            break;
-        case 409:
-            status_text = "Conflict";
-            break;
-        case 415:
-            status_text = "Unsupported Media Type";
-            break;
-        default:
-            status_text = "Internal Server Error";
-            status_code = 500;
+
+// everything about a file's body: its length, validators and, for text that may come precompressed, its coding;
+// ranges is whether byte ranges of it can be asked for; buffer has to hold FILE_HEADERS_SIZE bytes
+size_t format_file_headers(char *buffer, size_t content_length, const Validators *validators,
+                           ContentEncoding encoding, bool vary, bool ranges) {
+    size_t length = snprintf(buffer, FILE_HEADERS_SIZE, "Content-Length: %zu\r\n", content_length);
+    length += format_validators(buffer + length, validators);
+    if (encoding != ENCODING_IDENTITY) {
+        length += snprintf(buffer + length, FILE_HEADERS_SIZE - length, "Content-Encoding: %s\r\n",
+                           encoding_name(encoding));
+    }
+    if (vary) {
+        length += snprintf(buffer + length, FILE_HEADERS_SIZE - length, "Vary: Accept-Encoding\r\n");
+    }
+    if (ranges) {
+        length += snprintf(buffer + length, FILE_HEADERS_SIZE - length, "Accept-Ranges: bytes\r\n");
     }
+    return length;
+}
 
-    sprintf(response_header, "HTTP/1.1 %d %s\r\n"
-                             "%s"
-                             "%s"
-                             "\r\n",
-            status_code, status_text, content_type_h, other);
 
-    send(client_socket, response_header, strlen(response_header), 0);
+// a 304 carries the same validators and Vary as the 200 it stands in for
+static void send_not_modified(int client_socket, const Validators *validators, bool vary) {
+    char other[VALIDATOR_HEADERS_SIZE + 32];
+    size_t length = format_validators(other, validators);
+    if (vary) {
+        snprintf(other + length, sizeof(other) - length, "Vary: Accept-Encoding\r\n");
+    }
+    send_headers(client_socket, 304, NULL, other);
 }
 
 
-static void send_file(int client_socket, int fd) {
+static bool copy_file(int client_socket, int fd, off_t offset, off_t end) {
     char buffer[4096];
-    ssize_t bytes_read;
-    while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) {
-        send(client_socket, buffer, bytes_read, 0);
+    while (offset < end) {
+        // offset < end, so the difference is positive and fits once it's below the buffer size
+        size_t chunk = end - offset < (off_t)sizeof(buffer) ? (size_t)(end - offset) : sizeof(buffer);
+        ssize_t bytes_read = pread(fd, buffer, chunk, offset);
+        if (bytes_read <= 0) {
+            return false;
+        }
+        offset += bytes_read;
+        if (!send_all(client_socket, buffer, (size_t)bytes_read, offset < end ? MSG_MORE : 0)) {
+            return false;
+        }
     }
+    return true;
 }
 
 
-void send_error_message(int client_socket, int status_code, const char *message) {
-    char err_message[MAX_ERROR_JSON_LENGTH];
-    sprintf(err_message, "{\"error\": {\"message\": \"%s\"}}\n", message);
-    char content_length[64];
-    sprintf(content_length, "Content-Length: %ld\r\n", strlen(err_message));
+// moves the file through a pipe, for when sendfile can't take it; still no copy through user space
+static bool splice_file(int client_socket, int fd, off_t offset, off_t end) {
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        return copy_file(client_socket, fd, offset, end);
+    }
+    off_t start = offset;
+    bool sent = true;
+    while (sent && offset < end) {
+        size_t chunk = end - offset < SPLICE_CHUNK_SIZE ? end - offset : SPLICE_CHUNK_SIZE;
+        ssize_t filled = splice(fd, &offset, pipe_fds[1], NULL, chunk, SPLICE_F_MORE);
+        if (filled < 0 && errno == EINTR) {
+            continue;
+        } else if (filled < 0 && (errno == EINVAL || errno == ENOSYS) && offset == start) {
+            sent = copy_file(client_socket, fd, offset, end);
+            break;
+        } else if (filled <= 0) {
+            sent = false;
+            break;
+        }
+        while (filled > 0) {
+            ssize_t drained = splice(pipe_fds[0], NULL, client_socket, NULL, filled,
+                                     offset < end ? SPLICE_F_MORE : 0);
+            if (drained > 0) {
+                filled -= drained;
+            } else if (drained < 0 && (errno == EINTR ||
+                                       (errno == EAGAIN && wait_until_writable(client_socket)))) {
+                continue;
+            } else {
+                sent = false;
+                break;
+            }
+        }
+    }
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return sent;
+}
+
 
-    send_headers(client_socket, status_code, "application/json", content_length);
-    send(client_socket, err_message, sizeof(err_message), 0);
+// the page cache goes straight to the socket; the headers were sent with MSG_MORE, so they share the first segment
+static bool send_file(int client_socket, int fd, off_t offset, off_t end) {
+    bool sent = true;
+    while (offset < end) {
+        ssize_t result = sendfile(client_socket, fd, &offset, end - offset);
+        if (result > 0) {
+            continue;
+        } else if (result < 0 && (errno == EINTR || (errno == EAGAIN && wait_until_writable(client_socket)))) {
+            continue;
+        } else if (result < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            sent = splice_file(client_socket, fd, offset, end);
+        } else {
+            // an error, or the file shrank after its length went out in the headers
+            sent = false;
+        }
+        break;
+    }
+    if (!sent) {
+        abandon_connection(client_socket);
+    }
+    return sent;
 }
 
 
-void try_sending_error_file(int client_socket, int status_code) {
-    char err_path[MAX_PATH_LENGTH];
-    snprintf(err_path, sizeof(err_path), DOCUMENT_ROOT"/errors/%d.html", status_code);
+// a single range goes out like a whole file with a Content-Range, several as multipart/byteranges; the body
+// comes from data when it's in memory, from fd otherwise
+static void send_ranges(int client_socket, const char *content_type, const Validators *validators, off_t size,
+                        const ByteRange *ranges, int count, const char *data, int fd) {
+    char response_header[HEADER_BLOCK_SIZE];
+    char other[FILE_HEADERS_SIZE + 64];
+    int header_length;
+    if (count == 1) {
+        int length = snprintf(other, sizeof(other), "Content-Range: bytes %lld-%lld/%lld\r\n",
+                              (long long)ranges[0].start, (long long)ranges[0].end - 1, (long long)size);
+        format_file_headers(other + length, ranges[0].end - ranges[0].start, validators, ENCODING_IDENTITY, false,
+                            true);
+        header_length = format_headers(response_header, client_socket, 206, content_type, other);
+        if (header_length == 0) {
+            return;
+        }
+        if (data) {
+            struct iovec vectors[2] = {
+                    {.iov_base = response_header, .iov_len = header_length},
+                    {.iov_base = (void *)(data + ranges[0].start), .iov_len = ranges[0].end - ranges[0].start},
+            };
+            send_vectors(client_socket, vectors, 2, 0);
+        } else if (send_all(client_socket, response_header, header_length, MSG_MORE)) {
+            send_file(client_socket, fd, ranges[0].start, ranges[0].end);
+        }
+        return;
+    }
 
-    int fd = open(err_path, O_RDONLY);
-    if (fd == -1) {
-        perror("Error opening error file");
-        if (status_code == 500) {
-            send_headers(client_socket, 500, "text/html", NULL);
-            const char err_msg[] = "<h1>Internal Server Error</h1>\r\n"
-                                   "\t<p>Sorry, something went wrong on our side. Please try again later.</p>\r\n";
-            send(client_socket, err_msg, sizeof(err_msg), 0);
-        } else {
-            try_sending_error_file(client_socket, 500);
+    Multipart multipart;
+    multipart_init(&multipart, content_type, size, ranges, count);
+    format_file_headers(other, multipart.content_length, validators, ENCODING_IDENTITY, false, true);
+    header_length = format_headers(response_header, client_socket, 206, multipart.content_type, other);
+    if (header_length == 0) {
+        return;
+    }
+    if (data) {
+        struct iovec vectors[2 * MAX_RANGES + 2];
+        int vector_count = 0;
+        vectors[vector_count++] = (struct iovec) {response_header, header_length};
+        for (int i = 0; i < count; ++i) {
+            vectors[vector_count++] = (struct iovec) {multipart.part_headers[i], multipart.part_header_lengths[i]};
+            vectors[vector_count++] = (struct iovec) {(void *)(data + ranges[i].start), ranges[i].end - ranges[i].start};
         }
+        vectors[vector_count++] = (struct iovec) {multipart.trailer, multipart.trailer_length};
+        send_vectors(client_socket, vectors, vector_count, 0);
         return;
     }
+    bool sent = send_all(client_socket, response_header, header_length, MSG_MORE);
+    for (int i = 0; sent && i < count; ++i) {
+        sent = send_all(client_socket, multipart.part_headers[i], multipart.part_header_lengths[i], MSG_MORE) &&
+               send_file(client_socket, fd, ranges[i].start, ranges[i].end);
+    }
+    if (sent) {
+        send_all(client_socket, multipart.trailer, multipart.trailer_length, 0);
+    }
+}
+
+
+// true if the Range in req was answered, with a 206 or a 416
+static bool try_sending_ranges(int client_socket, const HttpRequest *req, const char *content_type,
+                               const Validators *validators, off_t size, const char *data, int fd) {
+    ByteRange ranges[MAX_RANGES];
+    int count;
+    RangeStatus status = request_ranges(req, validators, size, ranges, &count);
+    if (status == RANGE_UNSATISFIABLE) {
+        char content_range[64];
+        snprintf(content_range, sizeof(content_range), "Content-Range: bytes */%lld\r\n", (long long)size);
+        send_headers(client_socket, 416, NULL, content_range);
+        return true;
+    } else if (status == RANGE_SATISFIABLE) {
+        send_ranges(client_socket, content_type, validators, size, ranges, count, data, fd);
+        return true;
+    }
+    return false;
+}
+
+
+static bool has_range(const HttpRequest *req) {
+    return req && request_header(req, HDR_RANGE).ptr;
+}
+
+
+// sends the headers and contents of an open file and closes it, or just a 304 if req already has the file;
+// false if nothing could be sent
+static bool send_open_file(int client_socket, const HttpRequest *req, int status_code, const char *content_type,
+                           ContentEncoding encoding, int fd, const char *path) {
     struct stat file_stat;
-    if (stat(err_path, &file_stat) != 0) {
-        perror("Error getting file stats");
-        try_sending_error_file(client_socket, 500);
-        return;
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        fprintf(stderr, "Can't send %s: not a regular file\n", path);
+        close(fd);
+        return false;
     }
 
     off_t file_size = file_stat.st_size;
-    char content_length[64];
-    snprintf(content_length, sizeof(content_length), "Content-Length: %ld\r\n", file_size);
+    bool vary = status_code == 200 && is_compressible(content_type);
+    Validators validators;
+    validators_init(&validators, file_size, file_stat.st_mtim.tv_sec, file_stat.st_mtim.tv_nsec, encoding);
+    if (status_code == 200 && request_not_modified(req, &validators)) {
+        send_not_modified(client_socket, &validators, vary);
+        close(fd);
+        return true;
+    }
+    if (status_code == 200 && try_sending_ranges(client_socket, req, content_type, &validators, file_size, NULL, fd)) {
+        close(fd);
+        return true;
+    }
+    char other[FILE_HEADERS_SIZE];
+    format_file_headers(other, file_size, &validators, encoding, vary, status_code == 200);
 
-    send_headers(client_socket, status_code, "text/html", content_length);
-    send_file(client_socket, fd);
+    char response_header[HEADER_BLOCK_SIZE];
+    int length = format_headers(response_header, client_socket, status_code, content_type, other);
+    if (length > 0 && send_all(client_socket, response_header, length, file_size > 0 ? MSG_MORE : 0)) {
+        send_file(client_socket, fd, 0, file_size);
+    }
     close(fd);
+    return true;
+}
+
+
+void response_init(Response *response, int client_socket, int status_code, const char *content_type) {
+    response->client_socket = client_socket;
+    response->status_code = status_code;
+    response->content_type = content_type;
+    response->headers[0] = '\0';
+    response->headers_length = 0;
+    response->fragment_count = 0;
+    response->body_length = 0;
+    response->overflowed = false;
 }
 
 
-void try_sending_file(int client_socket, const char *file_path) {
-    int fd = open(file_path, O_RDONLY);
+// header is a complete line, CRLF included
+void response_add_header(Response *response, const char *header) {
+    size_t length = strlen(header);
+    if (response->headers_length + length >= RESPONSE_HEADERS_SIZE) {
+        fprintf(stderr, "Response headers exceed %d bytes\n", RESPONSE_HEADERS_SIZE);
+        response->overflowed = true;
+        return;
+    }
+    memcpy(response->headers + response->headers_length, header, length + 1);
+    response->headers_length += length;
+}
+
+
+void response_add_body(Response *response, const void *data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    if (response->fragment_count == RESPONSE_MAX_FRAGMENTS) {
+        fprintf(stderr, "Response body exceeds %d fragments\n", RESPONSE_MAX_FRAGMENTS);
+        response->overflowed = true;
+        return;
+    }
+    // the first vector is left for the status line and headers
+    struct iovec *fragment = &response->fragments[++response->fragment_count];
+    fragment->iov_base = (void *)data;
+    fragment->iov_len = length;
+    response->body_length += length;
+}
+
+
+// swaps the body for its gzipped form, unless that came out no smaller
+static void compress_body(Response *response) {
+    if (!compressor_start()) {
+        return;
+    }
+    for (int i = 1; i <= response->fragment_count; ++i) {
+        const struct iovec *fragment = &response->fragments[i];
+        if (!compressor_deflate(fragment->iov_base, fragment->iov_len,
+                                i == response->fragment_count ? Z_FINISH : Z_NO_FLUSH)) {
+            return;
+        }
+    }
+    size_t length;
+    const char *output = compressor_output(&length);
+    if (length >= response->body_length) {
+        return;
+    }
+    response->fragments[1].iov_base = (void *)output;
+    response->fragments[1].iov_len = length;
+    response->fragment_count = 1;
+    response->body_length = length;
+    response_add_header(response, "Content-Encoding: gzip\r\n");
+}
+
+
+bool response_send(Response *response) {
+    if (response->overflowed) {
+        try_sending_error_file(response->client_socket, 500);
+        return false;
+    }
+    const Connection *conn = connection_find(response->client_socket);
+    if (conn && conn->compressible && is_compressible(response->content_type)) {
+        response_add_header(response, "Vary: Accept-Encoding\r\n");
+        if (conn->accepts_gzip && response->body_length >= COMPRESSION_MIN_SIZE) {
+            compress_body(response);
+        }
+    }
+    if (response->content_type) {
+        char content_length[64];
+        snprintf(content_length, sizeof(content_length), "Content-Length: %zu\r\n", response->body_length);
+        response_add_header(response, content_length);
+    }
+
+    char response_header[HEADER_BLOCK_SIZE];
+    int header_length = format_headers(response_header, response->client_socket, response->status_code,
+                                       response->content_type, response->headers);
+    if (header_length == 0) {
+        return false;
+    }
+    response->fragments[0].iov_base = response_header;
+    response->fragments[0].iov_len = header_length;
+    return send_vectors(response->client_socket, response->fragments, response->fragment_count + 1, 0);
+}
+
+
+#ifdef USE_IO_URING
+typedef struct {
+    Ring ring;
+    char chunks[URING_FILE_CHUNKS][URING_FILE_CHUNK_SIZE];
+} WorkerRing;
+
+// every worker sets up its own ring on first use, and never tries again once that failed
+static _Thread_local WorkerRing *worker_ring = NULL;
+static _Thread_local bool worker_ring_unavailable = false;
+
+
+static WorkerRing *get_worker_ring() {
+    if (!worker_ring && !worker_ring_unavailable) {
+        worker_ring = malloc(sizeof(WorkerRing));
+        if (!worker_ring || !ring_init(&worker_ring->ring, URING_FILE_ENTRIES)) {
+            free(worker_ring);
+            worker_ring = NULL;
+            worker_ring_unavailable = true;
+        }
+    }
+    return worker_ring;
+}
+
+
+// submits everything queued and collects one result per operation, indexed by their user data
+static bool complete_operations(Ring *ring, unsigned count, int *results) {
+    unsigned completed = 0;
+    while (completed < count) {
+        int status = ring_submit_and_wait(ring, count - completed);
+        if (status < 0 && status != -EINTR) {
+            fprintf(stderr, "io_uring_enter failed: %s\n", strerror(-status));
+            return false;
+        }
+        struct io_uring_cqe *cqe;
+        while ((cqe = ring_peek_cqe(ring))) {
+            results[cqe->user_data] = cqe->res;
+            ring_cqe_seen(ring);
+            completed++;
+        }
+    }
+    return true;
+}
+
+
+static struct io_uring_sqe *queue_operation(Ring *ring, int opcode, int fd, const void *addr, unsigned len,
+                                            unsigned long long offset, unsigned user_data, bool linked) {
+    struct io_uring_sqe *sqe = ring_get_sqe(ring);
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    if (linked) {
+        sqe->flags = IOSQE_IO_LINK;
+    }
+    return sqe;
+}
+
+
+// sends never wait in the ring, where nothing would time them out; what doesn't fit in the socket buffer right away
+// goes out through send_all, which gives up on a client that stops reading after SEND_TIMEOUT_MS
+static void queue_send(Ring *ring, int client_socket, const void *data, unsigned length, unsigned user_data,
+                       bool linked) {
+    queue_operation(ring, IORING_OP_SEND, client_socket, data, length, 0, user_data, linked)->msg_flags = MSG_DONTWAIT;
+}
+
+
+// opens the file through the ring, then sends the headers and the file as one chain of linked reads and sends per
+// batch of chunks; returns false before anything was sent if the regular path has to take over
+static bool uring_send_file(int client_socket, const HttpRequest *req, int status_code, const char *content_type,
+                            ContentEncoding encoding, const char *path) {
+    WorkerRing *worker = get_worker_ring();
+    if (!worker) {
+        return false;
+    }
+    Ring *ring = &worker->ring;
+
+    int results[2 * URING_FILE_CHUNKS + 1];
+    queue_operation(ring, IORING_OP_OPENAT, AT_FDCWD, path, 0, 0, 0, false)->open_flags =
+            O_RDONLY | O_CLOEXEC | (encoding != ENCODING_IDENTITY ? O_NOFOLLOW : 0);
+    if (!complete_operations(ring, 1, results) || results[0] < 0) {
+        return false;
+    }
+    int fd = results[0];
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        close(fd);
+        return false;
+    }
+
+    unsigned long long file_size = file_stat.st_size;
+    bool vary = status_code == 200 && is_compressible(content_type);
+    Validators validators;
+    validators_init(&validators, file_size, file_stat.st_mtim.tv_sec, file_stat.st_mtim.tv_nsec, encoding);
+    if (status_code == 200 && request_not_modified(req, &validators)) {
+        send_not_modified(client_socket, &validators, vary);
+        close(fd);
+        return true;
+    }
+
+    char response_header[HEADER_BLOCK_SIZE];
+    char other[FILE_HEADERS_SIZE];
+    format_file_headers(other, file_size, &validators, encoding, vary, status_code == 200);
+    int header_length = format_headers(response_header, client_socket, status_code, content_type, other);
+    if (header_length == 0) {
+        close(fd);
+        return true;
+    }
+
+    unsigned long long offset = 0;
+    bool header_sent = false;
+    bool sent = true;
+    do {
+        unsigned count = 0;
+        unsigned expected[2 * URING_FILE_CHUNKS + 1];
+        // what each send carries and how far into the file the response is once it's through; NULL for reads
+        const char *buffers[2 * URING_FILE_CHUNKS + 1];
+        unsigned long long ends[2 * URING_FILE_CHUNKS + 1];
+        if (!header_sent) {
+            queue_send(ring, client_socket, response_header, header_length, count, file_size > 0);
+            buffers[count] = response_header;
+            ends[count] = offset;
+            expected[count++] = header_length;
+        }
+        for (int i = 0; i < URING_FILE_CHUNKS && offset < file_size; ++i) {
+            unsigned chunk = file_size - offset < URING_FILE_CHUNK_SIZE ? file_size - offset : URING_FILE_CHUNK_SIZE;
+            offset += chunk;
+            queue_operation(ring, IORING_OP_READ, fd, worker->chunks[i], chunk, offset - chunk, count, true);
+            buffers[count] = NULL;
+            ends[count] = offset;
+            expected[count++] = chunk;
+            queue_send(ring, client_socket, worker->chunks[i], chunk, count,
+                       i + 1 < URING_FILE_CHUNKS && offset < file_size);
+            buffers[count] = worker->chunks[i];
+            ends[count] = offset;
+            expected[count++] = chunk;
+        }
+
+        if (!complete_operations(ring, count, results)) {
+            sent = false;
+        }
+        // a short send cancels the rest of the chain; its remainder goes out directly and the next batch picks up
+        // after it. A short read means the file changed underneath, the response can't be finished
+        for (unsigned i = 0; sent && i < count; ++i) {
+            if (results[i] == (int)expected[i]) {
+                header_sent = true;
+                continue;
+            }
+            // a send that found the socket buffer full comes back with nothing sent
+            int done = results[i] == -EAGAIN ? 0 : results[i];
+            if (buffers[i] && done >= 0 && send_all(client_socket, buffers[i] + done, expected[i] - done, 0)) {
+                header_sent = true;
+                offset = ends[i];
+                break;
+            }
+            fprintf(stderr, "Failed to send %s: %s\n", path, results[i] < 0 ? strerror(-results[i]) : "short read");
+            sent = false;
+        }
+    } while (sent && offset < file_size);
+
+    if (!sent) {
+        abandon_connection(client_socket);
+    }
+    close(fd);
+    return true;
+}
+#endif
+
+
+static bool keeps_alive(int client_socket) {
+    const Connection *conn = connection_find(client_socket);
+    return conn && conn->keep_alive;
+}
+
+
+void send_error_message(int client_socket, int status_code, const char *message) {
+    const PreformattedResponse *preformatted = error_message(status_code, message, keeps_alive(client_socket));
+    if (preformatted) {
+        send_preformatted(client_socket, preformatted);
+        return;
+    }
+
+    char err_message[MAX_ERROR_JSON_LENGTH];
+    size_t length = format_error_json(err_message, message);
+
+    Response response;
+    response_init(&response, client_socket, status_code, "application/json");
+    response_add_body(&response, err_message, length);
+    response_send(&response);
+}
+
+
+void try_sending_error_file(int client_socket, int status_code) {
+    send_preformatted(client_socket, error_page(status_code, keeps_alive(client_socket)));
+}
+
+
+// one lookup and one sendmsg; false if the requested path isn't cached
+bool try_sending_cached_file(int client_socket, const HttpRequest *req) {
+    StaticAsset *asset = static_cache_acquire(req->path);
+    if (!asset) {
+        return false;
+    }
+    // ranges are always of the identity representation
+    ContentEncoding encoding = has_range(req) ? ENCODING_IDENTITY : negotiate_encoding(req, asset->available);
+    const AssetVariant *variant = &asset->variants[encoding];
+    if (request_not_modified(req, &variant->validators)) {
+        send_not_modified(client_socket, &variant->validators, asset->vary);
+        static_cache_release(asset);
+        return true;
+    }
+    if (try_sending_ranges(client_socket, req, get_content_type(asset->path), &variant->validators, variant->size,
+                           variant->data, -1)) {
+        static_cache_release(asset);
+        return true;
+    }
+    const Connection *conn = connection_find(client_socket);
+    int keep_alive = conn && conn->keep_alive;
+    char response_header[HEADER_BLOCK_SIZE];
+    memcpy(response_header, variant->headers[keep_alive], variant->header_lengths[keep_alive]);
+    copy_date_header(response_header + asset->date_offset);
+
+    struct iovec vectors[2] = {
+            {.iov_base = response_header, .iov_len = variant->header_lengths[keep_alive]},
+            {.iov_base = variant->data, .iov_len = variant->size},
+    };
+    send_vectors(client_socket, vectors, 2, 0);
+    static_cache_release(asset);
+    return true;
+}
+
+
+static bool sidecar_usable(const char *sidecar_path, const struct stat *original) {
+    struct stat sidecar;
+    if (lstat(sidecar_path, &sidecar) != 0 || !S_ISREG(sidecar.st_mode) || sidecar.st_size >= original->st_size) {
+        return false;
+    }
+    return sidecar.st_mtim.tv_sec > original->st_mtim.tv_sec ||
+           (sidecar.st_mtim.tv_sec == original->st_mtim.tv_sec && sidecar.st_mtim.tv_nsec >= original->st_mtim.tv_nsec);
+}
+
+
+// the precompressed file the client would rather have, left in sidecar_path; a sidecar only counts while it's
+// smaller than and at least as new as the file it was compressed from
+static ContentEncoding find_sidecar(const HttpRequest *req, const char *file_path, const char *content_type,
+                                    char *sidecar_path) {
+    unsigned every_encoding = ENCODING_BIT(ENCODING_COUNT) - 1;
+    if (!is_compressible(content_type) || has_range(req) ||
+        negotiate_encoding(req, every_encoding) == ENCODING_IDENTITY) {
+        return ENCODING_IDENTITY;
+    }
+    struct stat original;
+    if (stat(file_path, &original) != 0) {
+        return ENCODING_IDENTITY;
+    }
+    unsigned available = ENCODING_BIT(ENCODING_IDENTITY);
+    for (int encoding = ENCODING_IDENTITY + 1; encoding < ENCODING_COUNT; ++encoding) {
+        int length = snprintf(sidecar_path, MAX_PATH_LENGTH, "%s%s", file_path, encoding_suffix(encoding));
+        if (length < MAX_PATH_LENGTH && sidecar_usable(sidecar_path, &original)) {
+            available |= ENCODING_BIT(encoding);
+        }
+    }
+    ContentEncoding encoding = negotiate_encoding(req, available);
+    snprintf(sidecar_path, MAX_PATH_LENGTH, "%s%s", file_path, encoding_suffix(encoding));
+    return encoding;
+}
+
+
+void try_sending_file(int client_socket, const HttpRequest *req, const char *file_path) {
+    const char *content_type = get_content_type(file_path);
+    char sidecar_path[MAX_PATH_LENGTH];
+    ContentEncoding encoding = find_sidecar(req, file_path, content_type, sidecar_path);
+    const char *path = encoding == ENCODING_IDENTITY ? file_path : sidecar_path;
+#ifdef USE_IO_URING
+    if (!has_range(req) && uring_send_file(client_socket, req, 200, content_type, encoding, path)) {
+        return;
+    }
+#endif
+    int fd = open(path, O_RDONLY | O_CLOEXEC | (encoding != ENCODING_IDENTITY ? O_NOFOLLOW : 0));
     if (fd == -1) {
         perror("Error opening file");
         try_sending_error_file(client_socket, 500);
         return;
     }
-    struct stat file_stat;
-    if (stat(file_path, &file_stat) != 0) {
-        perror("Error getting file stats");
+    if (!send_open_file(client_socket, req, 200, content_type, encoding, fd, path)) {
         try_sending_error_file(client_socket, 500);
+    }
+}
+
+
+void response_stream_start(ResponseStream *stream, int client_socket, const HttpRequest *req, int status_code,
+                           const char *content_type) {
+    const Connection *conn = connection_find(client_socket);
+    stream->client_socket = client_socket;
+    stream->status_code = status_code;
+    stream->content_type = content_type;
+    stream->chunked = !slice_equals(req->protocol, "HTTP/1.0");
+    stream->vary = conn && conn->compressible && is_compressible(content_type);
+    stream->gzip = stream->vary && conn->accepts_gzip;
+    stream->headers_sent = false;
+    stream->failed = false;
+    stream->length = 0;
+}
+
+
+// commits to streaming; held back with MSG_MORE, so the headers share a segment with the first chunk
+static void send_stream_headers(ResponseStream *stream) {
+    stream->headers_sent = true;
+    // without chunks, the end of the body is the connection closing
+    if (!stream->chunked) {
+        abandon_connection(stream->client_socket);
+    }
+    if (stream->gzip && !compressor_start()) {
+        stream->gzip = false;
+    }
+    char other[128];
+    snprintf(other, sizeof(other), "%s%s%s", stream->chunked ? "Transfer-Encoding: chunked\r\n" : "",
+             stream->gzip ? "Content-Encoding: gzip\r\n" : "", stream->vary ? "Vary: Accept-Encoding\r\n" : "");
+    char response_header[HEADER_BLOCK_SIZE];
+    int length = format_headers(response_header, stream->client_socket, stream->status_code, stream->content_type,
+                                other);
+    stream->failed = length == 0 || !send_all(stream->client_socket, response_header, length, MSG_MORE);
+}
+
+
+static void send_chunk(ResponseStream *stream, const char *data, size_t length) {
+    if (stream->failed || length == 0) {
+        return;
+    }
+    if (!stream->chunked) {
+        stream->failed = !send_all(stream->client_socket, data, length, 0);
         return;
     }
+    char size_line[STREAM_CHUNK_PREFIX];
+    int size_length = snprintf(size_line, sizeof(size_line), "%zx\r\n", length);
+    struct iovec vectors[3] = {
+            {.iov_base = size_line, .iov_len = size_length},
+            {.iov_base = (void *)data, .iov_len = length},
+            {.iov_base = "\r\n", .iov_len = 2},
+    };
+    stream->failed = !send_vectors(stream->client_socket, vectors, 3, 0);
+}
 
-    off_t file_size = file_stat.st_size;
-    const char *content_type = get_content_type(file_path);
-    char content_length[64];
-    snprintf(content_length, sizeof(content_length), "Content-Length: %ld\r\n", file_size);
 
-    send_headers(client_socket, 200, content_type, content_length);
-    send_file(client_socket, fd);
-    close(fd);
+// hands the buffer on, through deflate when compressing; flush says how much of it zlib has to let out
+static void drain(ResponseStream *stream, int flush) {
+    if (!stream->headers_sent) {
+        send_stream_headers(stream);
+    }
+    if (stream->failed) {
+        return;
+    }
+    if (stream->gzip) {
+        if (!compressor_deflate(stream->buffer, stream->length, flush)) {
+            response_stream_abort(stream);
+            return;
+        }
+        size_t length;
+        const char *output = compressor_output(&length);
+        send_chunk(stream, output, length);
+        compressor_consume();
+    } else {
+        send_chunk(stream, stream->buffer, stream->length);
+    }
+    stream->length = 0;
+}
+
+
+// sends everything written so far, so the client can start on it
+void response_stream_flush(ResponseStream *stream) {
+    if (stream->failed || (stream->headers_sent && stream->length == 0)) {
+        return;
+    }
+    drain(stream, Z_SYNC_FLUSH);
+}
+
+
+void response_stream_write(ResponseStream *stream, const char *data, size_t length) {
+    while (length > 0 && !stream->failed) {
+        if (stream->length == STREAM_BUFFER_SIZE) {
+            drain(stream, Z_NO_FLUSH);
+        }
+        size_t space = STREAM_BUFFER_SIZE - stream->length;
+        size_t part = length < space ? length : space;
+        memcpy(stream->buffer + stream->length, data, part);
+        stream->length += part;
+        data += part;
+        length -= part;
+    }
+}
+
+
+void response_stream_printf(ResponseStream *stream, const char *format, ...) {
+    if (stream->failed) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    size_t space = STREAM_BUFFER_SIZE - stream->length;
+    int length = vsnprintf(stream->buffer + stream->length, space, format, args);
+    va_end(args);
+    if (length < 0) {
+        response_stream_abort(stream);
+        return;
+    }
+    if ((size_t)length < space) {
+        stream->length += length;
+        return;
+    }
+
+    // didn't fit; format again into a buffer of its own and copy that in
+    char *formatted = malloc(length + 1);
+    if (!formatted) {
+        perror("Failed to allocate memory for a response fragment");
+        response_stream_abort(stream);
+        return;
+    }
+    va_start(args, format);
+    vsnprintf(formatted, length + 1, format, args);
+    va_end(args);
+    response_stream_write(stream, formatted, length);
+    free(formatted);
+}
+
+
+void response_stream_end(ResponseStream *stream) {
+    if (stream->failed) {
+        return;
+    }
+    // the whole body is still here, so it can go out with a Content-Length, compressed if it's big enough
+    if (!stream->headers_sent) {
+        stream->headers_sent = true;
+        Response response;
+        response_init(&response, stream->client_socket, stream->status_code, stream->content_type);
+        response_add_body(&response, stream->buffer, stream->length);
+        stream->failed = !response_send(&response);
+        return;
+    }
+    drain(stream, Z_FINISH);
+    if (stream->chunked && !stream->failed) {
+        stream->failed = !send_all(stream->client_socket, "0\r\n\r\n", 5, 0);
+    }
+}
+
+
+// before the headers are out the client can still be told what happened; after that, the only way left to report
+// an error is cutting the response short
+void response_stream_abort(ResponseStream *stream) {
+    bool headers_sent = stream->headers_sent;
+    stream->length = 0;
+    stream->headers_sent = true;
+    stream->failed = true;
+    if (headers_sent) {
+        abandon_connection(stream->client_socket);
+    } else {
+        try_sending_error_file(stream->client_socket, 500);
+    }
 }
 
 
 void handle_invalid_http_request(RequestParsingStatus status, int client_socket) {
     if (status == REQ_PARSE_INVALID_FORMAT) {
         send_error_message(client_socket, 400, "Invalid HTTP request");
+    } else if (status == REQ_PARSE_UNSUPPORTED_TRANSFER_ENCODING) {
+        send_error_message(client_socket, 501, "Transfer-Encoding is not supported, send a Content-Length instead");
+    } else if (status == REQ_PARSE_BODY_TOO_LARGE) {
+        send_error_message(client_socket, 413, "Request body is too large");
     } else {
         try_sending_error_file(client_socket, 500);
     }
@@ -2,7 +2,52 @@
 #define HTTP_SERVER_RESPONSE_H
 
 #include "request.h"
+#include "validators.h"
+#include <stddef.h>
+#include <sys/uio.h>
 
+#define RESPONSE_MAX_FRAGMENTS 16
+#define RESPONSE_HEADERS_SIZE 512
+#define STREAM_BUFFER_SIZE 8192
+#define STREAM_CHUNK_PREFIX 16
+#define FILE_HEADERS_SIZE (VALIDATOR_HEADERS_SIZE + 128)
+
+
+// a complete response gathered as iovecs, so the status line, headers and body leave in one sendmsg;
+// body fragments are referenced rather than copied and have to stay alive until response_send
+typedef struct {
+    int client_socket;
+    int status_code;
+    const char *content_type;
+    char headers[RESPONSE_HEADERS_SIZE];
+    size_t headers_length;
+    struct iovec fragments[RESPONSE_MAX_FRAGMENTS + 1];
+    int fragment_count;
+    size_t body_length;
+    bool overflowed;
+} Response;
+
+// a body sent while it is still being produced, chunked on HTTP/1.1 and delimited by the connection closing on 1.0;
+// the headers are held back until the first chunk, and a body that never outgrows the buffer goes out as a Response
+typedef struct {
+    int client_socket;
+    int status_code;
+    const char *content_type;
+    bool chunked;
+    bool vary;
+    bool gzip;
+    bool headers_sent;
+    bool failed;
+    size_t length;
+    char buffer[STREAM_BUFFER_SIZE];
+} ResponseStream;
+
+void response_never_wait();
+
+const char *get_content_type(const char *path);
+
+size_t format_file_headers(char *buffer, size_t content_length, const Validators *validators,
+                           ContentEncoding encoding, bool vary, bool ranges);
 
 void send_headers(int client_socket, int status_code, const char *content_type, const char *other);
 
@@ -10,7 +55,30 @@ void try_sending_error_file(int client_socket, int status_code);
 
 void send_error_message(int client_socket, int status_code, const char *message);
 
-void try_sending_file(int client_socket, const char *file_path);
+bool try_sending_cached_file(int client_socket, const HttpRequest *req);
+
+void try_sending_file(int client_socket, const HttpRequest *req, const char *file_path);
+
+void response_init(Response *response, int client_socket, int status_code, const char *content_type);
+
+void response_add_header(Response *response, const char *header);
+
+void response_add_body(Response *response, const void *data, size_t length);
+
+bool response_send(Response *response);
+
+void response_stream_start(ResponseStream *stream, int client_socket, const HttpRequest *req, int status_code,
+                           const char *content_type);
+
+void response_stream_write(ResponseStream *stream, const char *data, size_t length);
+
+void response_stream_printf(ResponseStream *stream, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+void response_stream_flush(ResponseStream *stream);
+
+void response_stream_end(ResponseStream *stream);
+
+void response_stream_abort(ResponseStream *stream);
 
 void handle_invalid_http_request(RequestParsingStatus status, int client_socket);
 
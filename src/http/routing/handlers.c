@@ -6,6 +6,8 @@
 #include "../../db/sessions.h"
 #include "../../db/verifications.h"
 #include "../../middlewares/session_middleware.h"
+#include "../connection.h"
+#include "../util/string_builder.h"
 #include <string.h>
 #include <stdlib.h>
 #include <arpa/inet.h>
@@ -13,15 +15,29 @@
 #define SEND_EMAILS false
 #define SERVER_DOMAIN "http://localhost:8080"
 #define PAGE_SIZE 8
-#define MAX_TODOS_HTML_SIZE 20240
 #define MAX_COOKIE_SIZE 256
 
 
+// where a page of todos starts: after or before the ids at the edges of the page the link was on, or page alone for
+// the old offset links
+typedef struct {
+    int page;
+    bool after;
+    bool before;
+    int cursor_id;
+} TodoPageRequest;
+
+
 static void get_home(HttpRequest *req, Task *context);
 
 static void get_about(HttpRequest *req, Task *context);
 
-static void get_todo_page(HttpRequest *req, Task *context, int user_id, const char *csrf_token);
+static void get_todo_page(HttpRequest *req, Task *context, QueryBatch *batch, const TodoPageRequest *request,
+                          const char *csrf_token);
+
+static int parse_todo_page_request(Slice query_string, TodoPageRequest *request);
+
+static bool queue_todo_page(QueryBatch *batch, const char *session_token, const TodoPageRequest *request);
 
 static void create_todo(HttpRequest *req, Task *context);
 
@@ -56,41 +72,39 @@ static void update_user(HttpRequest *req, Task *context);
 static void delete_user(HttpRequest *req, Task *context);
 
 static const Route ROUTES[] = {
-        {"/",                     GET,    get_home},
-        {"/about",                GET,    get_about},
-        {"/todo",                 POST,   create_todo},
-        {"/todo/",                PATCH,  update_todo},
-        {"/todo/",                DELETE, delete_todo},
-        {"/user/auth",            GET,    get_authentication_page},
-        {"/user/verify",          POST,   verify_email},
-        {"/user/verify",          GET,    get_verification_page},
-        {"/user/verify-new",      POST,   verify_new_email},
-        {"/user/forgot-password", POST,   forgot_password},
-        {"/user/reset-password",  GET,    get_reset_password_page},
-        {"/user/reset-password",  POST,   reset_password},
-        {"/user",                 GET,    get_user_page},
-        {"/user/signup",          POST,   signup_user},
-        {"/user/login",           POST,   login_user},
-        {"/user/logout",          POST,   logout_user},
-        {"/user",                 PATCH,  update_user},
-        {"/user",                 DELETE, delete_user}
+        {"/",                     GET,    get_home,                true},
+        {"/about",                GET,    get_about,               false},
+        {"/todo",                 POST,   create_todo,             false},
+        {"/todo/",                PATCH,  update_todo,             false},
+        {"/todo/",                DELETE, delete_todo,             false},
+        {"/user/auth",            GET,    get_authentication_page, false},
+        {"/user/verify",          POST,   verify_email,            false},
+        {"/user/verify",          GET,    get_verification_page,   false},
+        {"/user/verify-new",      POST,   verify_new_email,        false},
+        {"/user/forgot-password", POST,   forgot_password,         false},
+        {"/user/reset-password",  GET,    get_reset_password_page, false},
+        {"/user/reset-password",  POST,   reset_password,          false},
+        {"/user",                 GET,    get_user_page,           true},
+        {"/user/signup",          POST,   signup_user,             false},
+        {"/user/login",           POST,   login_user,              false},
+        {"/user/logout",          POST,   logout_user,             false},
+        {"/user",                 PATCH,  update_user,             false},
+        {"/user",                 DELETE, delete_user,             false}
 };
 
 static const int ROUTES_COUNT = sizeof(ROUTES) / sizeof(Route);
 
 
-static const Route *check_route(const char *url, Method method) {
+static const Route *check_route(Slice url, Method method) {
     if (method == DELETE || method == PATCH) {
-        const char *route_url;
         for (int i = 0; i < ROUTES_COUNT; ++i) {
-            route_url = ROUTES[i].url;
-            if (strncmp(url, route_url, strlen(route_url)) == 0 && method == ROUTES[i].method) {
+            if (slice_starts_with(url, ROUTES[i].url) && method == ROUTES[i].method) {
                 return &ROUTES[i];
             }
         }
     } else {
         for (int i = 0; i < ROUTES_COUNT; ++i) {
-            if (strcmp(url, ROUTES[i].url) == 0 && method == ROUTES[i].method) {
+            if (slice_equals(url, ROUTES[i].url) && method == ROUTES[i].method) {
                 return &ROUTES[i];
             }
         }
@@ -102,157 +116,233 @@ static const Route *check_route(const char *url, Method method) {
 static void get_authentication_page(HttpRequest *req, Task *context) {
     int client_socket = context->client_socket;
     const char *authentication_path = DOCUMENT_ROOT"/authentication.html";
-    try_sending_file(client_socket, authentication_path);
+    try_sending_file(client_socket, req, authentication_path);
 }
 
 
 static void get_home(HttpRequest *req, Task *context) {
     int client_socket = context->client_socket;
+    const char *location = "Location: /user/auth\r\n";
+    char session_token[MAX_TOKEN_LENGTH + 1];
+    if (!read_session_token(req, session_token)) {
+        send_headers(client_socket, 303, NULL, location);
+        return;
+    }
+    TodoPageRequest request;
+    int status = parse_todo_page_request(req->query_string, &request);
+
+    // the page is queued right behind the session check, both come back in a single round trip
+    QueryBatch batch;
+    if (!batch_begin(&batch, context->db_conn)) {
+        try_sending_error_file(client_socket, 500);
+        return;
+    }
+    if (!db_queue_session_info(&batch, session_token) ||
+        (status == 0 && !queue_todo_page(&batch, session_token, &request)) || !batch_send(&batch)) {
+        batch_end(&batch);
+        try_sending_error_file(client_socket, 500);
+        return;
+    }
+
     char csrf_token[MAX_TOKEN_LENGTH + 1];
     int user_id;
-
-    QueryResult qres = check_session(req->headers, context->db_conn, &user_id, csrf_token);
+    QueryResult qres = db_read_session_info(&batch, csrf_token, &user_id);
     if (qres == QRESULT_NONE_AFFECTED) {
-        const char *location = "Location: /user/auth\r\n";
         send_headers(client_socket, 303, NULL, location);
     } else if (qres == QRESULT_INTERNAL_ERROR) {
         try_sending_error_file(client_socket, 500);
+    } else if (status != 0) {
+        try_sending_error_file(client_socket, status);
     } else {
-        get_todo_page(req, context, user_id, csrf_token);
+        get_todo_page(req, context, &batch, &request, csrf_token);
     }
+    batch_end(&batch);
 }
 
 
 static void get_about(HttpRequest *req, Task *context) {
     int client_socket = context->client_socket;
     const char *about_path = DOCUMENT_ROOT"/about.html";
-    try_sending_file(client_socket, about_path);
+    try_sending_file(client_socket, req, about_path);
 }
 
 
-static void get_todo_page(HttpRequest *req, Task *context, int user_id, const char *csrf_token) {
-    int client_socket = context->client_socket;
-    const char *query_string = req->query_string;
-    int page = 1;
-
-    if (query_string) {
-        const char *expected_keys[] = {"page"};
-        bool found_keys[1] = {0};
-        if (!parse_url_data(query_string, expected_keys, 1, found_keys)) {
-            try_sending_error_file(client_socket, 400);
-            return;
-        }
+static void write_csrf_meta(ResponseStream *stream, const char *csrf_token) {
+    StringBuilder *html = string_builder_get();
+    builder_append_literal(html, "<meta name=\"csrf-token\" content=\"");
+    builder_append_escaped_str(html, csrf_token);
+    builder_append_literal(html, "\">");
+    response_stream_write(stream, html->data, html->length);
+}
+
+
+static void append_todo_item(StringBuilder *html, const Todo *todo) {
+    builder_append_literal(html, "<div class=\"todo-item\" data-todo-id=\"");
+    builder_append_int(html, todo->id);
+    builder_append_literal(html, "\">"
+                                 "<div class=\"todo-details\" onclick=\"toggleExpand(this)\">"
+                                 "<header class=\"todo-header\">"
+                                 "<p><time datetime=\"");
+    builder_append_escaped_str(html, todo->creation_time);
+    builder_append_literal(html, "\" class=\"creation-time\"></time></p>");
+    if (todo->due_time) {
+        builder_append_literal(html, "<p>Due: <time datetime=\"");
+        builder_append_escaped_str(html, todo->due_time);
+        builder_append_literal(html, "\" class=\"due-time\"></time></p>");
+    }
+    builder_append_literal(html, "</header><div class=\"todo-summary\"><p>");
+    builder_append_escaped_str(html, todo->summary);
+    builder_append_literal(html, "</p></div><div class=\"todo-task\"><p>");
+    builder_append_escaped_str(html, todo->task);
+    builder_append_literal(html, "</p>"
+                                 "</div></div>"
+                                 "<div class=\"todo-buttons\">"
+                                 "<button type=\"button\" class=\"edit-btn\">✏️</button>"
+                                 "<button type=\"button\" class=\"complete-btn\">✅</button>"
+                                 "</div></div>");
+}
+
+
+// page only labels the page in cursor links; without a cursor it's an offset
+static void append_page_link(StringBuilder *html, const char *label, const char *cursor, int cursor_id, int page) {
+    builder_append_literal(html, "<button><a href=\"/?");
+    if (cursor) {
+        builder_append(html, cursor, strlen(cursor));
+        builder_append_literal(html, "=");
+        builder_append_int(html, cursor_id);
+        builder_append_literal(html, "&amp;");
+    }
+    builder_append_literal(html, "page=");
+    builder_append_int(html, page);
+    builder_append_literal(html, "\">");
+    builder_append(html, label, strlen(label));
+    builder_append_literal(html, "</a></button>");
+}
+
+
+static bool read_id_param(Slice query_string, const char *key, int *id) {
+    char id_str[12];
+    if (!extract_url_param(query_string, key, id_str, sizeof(id_str) - 1)) {
+        return false;
+    }
+    return validate_url_id((Slice) {id_str, strlen(id_str)}, id);
+}
+
+
+// 0 when the query string names a page that can be queried, otherwise the status to answer with
+static int parse_todo_page_request(Slice query_string, TodoPageRequest *request) {
+    request->page = 1;
+    request->after = false;
+    request->before = false;
+    request->cursor_id = 0;
+    if (query_string.len == 0) {
+        return 0;
+    }
+
+    const char *expected_keys[] = {"page", "after", "before"};
+    bool found_keys[3] = {0};
+    if (!parse_url_data(query_string, expected_keys, 3, found_keys) || (found_keys[1] && found_keys[2])) {
+        return 400;
+    }
+    if (found_keys[0]) {
         char page_str[12];
         if (!extract_url_param(query_string, "page", page_str, sizeof(page_str) - 1)) {
-            try_sending_error_file(client_socket, 404);
-            return;
+            return 404;
         }
-        page = atoi(page_str);
-        if (page < 1) page = 1;
+        request->page = atoi(page_str);
+        if (request->page < 1) request->page = 1;
+    }
+    request->after = found_keys[1];
+    request->before = found_keys[2];
+    if ((request->after || request->before) &&
+        !read_id_param(query_string, request->after ? "after" : "before", &request->cursor_id)) {
+        return 400;
     }
+    return 0;
+}
 
-    int count;
-    Todo *todos = db_get_all_todos(context->db_conn, user_id, &count, page, PAGE_SIZE);
 
-    if (!todos) {
-        try_sending_error_file(client_socket, 500);
-        return;
+static bool queue_todo_page(QueryBatch *batch, const char *session_token, const TodoPageRequest *request) {
+    if (request->after) {
+        return db_queue_todos_after(batch, session_token, request->cursor_id, PAGE_SIZE);
+    } else if (request->before) {
+        return db_queue_todos_before(batch, session_token, request->cursor_id, PAGE_SIZE);
     }
+    return db_queue_todos(batch, session_token, request->page, PAGE_SIZE);
+}
 
-    int total_count = db_get_total_todos_count(context->db_conn, user_id);
-    int total_pages = 1;
-    if (total_count > 0) {
-        total_pages = (total_count + PAGE_SIZE - 1) / PAGE_SIZE;
-    }
 
-    char *csrf_remainder;
-    const char *template_path = DOCUMENT_ROOT"/templates/todos_page.html";
-    char *template = read_template(template_path, "<!-- CSRF_TOKEN -->", &csrf_remainder);
+// the page's todos were queued along with the session, they're read once the head of the page is out
+static void get_todo_page(HttpRequest *req, Task *context, QueryBatch *batch, const TodoPageRequest *request,
+                          const char *csrf_token) {
+    int client_socket = context->client_socket;
+    int page = request->page;
 
+    Template *template = template_acquire(TEMPLATE_TODOS_PAGE);
     if (!template) {
         try_sending_error_file(client_socket, 500);
-        free_todos(todos, count);
         return;
     }
 
-    char csrf_html[164];
-    sprintf(csrf_html, "<meta name=\"csrf-token\" content=\"%s\">", csrf_token);
+    // the head of the page goes out before the todos are queried, so the browser can start on the stylesheets
+    ResponseStream stream;
+    response_stream_start(&stream, client_socket, req, 200, "text/html");
+    response_stream_write(&stream, template->literals[0].ptr, template->literals[0].len);
+    write_csrf_meta(&stream, csrf_token);
+    response_stream_write(&stream, template->literals[1].ptr, template->literals[1].len);
+    response_stream_flush(&stream);
 
-    char *todos_remainder;
-    skip_placeholder(csrf_remainder, "<!-- TODO_ITEMS -->", &todos_remainder);
-    if (*todos_remainder == '\0') {
-        try_sending_error_file(client_socket, 500);
-        free_todos(todos, count);
+    int count, total_count;
+    Todo *todos = db_read_todos(batch, &count, &total_count);
+
+    if (!todos) {
+        response_stream_abort(&stream);
+        template_release(template);
         return;
     }
 
-    char *todos_html = malloc(MAX_TODOS_HTML_SIZE);
-    char *p = todos_html;
+    int total_pages = 1;
+    if (total_count > 0) {
+        total_pages = (total_count + PAGE_SIZE - 1) / PAGE_SIZE;
+    }
+
+    StringBuilder *html = string_builder_get();
     for (int i = 0; i < count; ++i) {
-        p += sprintf(p,
-                     "<div class=\"todo-item\" data-todo-id=\"%d\">"
-                     "<div class=\"todo-details\" onclick=\"toggleExpand(this)\">"
-                     "<header class=\"todo-header\">"
-                     "<p><time datetime=\"%s\" class=\"creation-time\"></time></p>", todos[i].id,
-                     todos[i].creation_time);
-        if (todos[i].due_time) {
-            p += sprintf(p, "<p>Due: <time datetime=\"%s\" class=\"due-time\"></time></p>", todos[i].due_time);
-        }
-        p += sprintf(p,
-                     "</header>"
-                     "<div class=\"todo-summary\">"
-                     "<p>%s</p>"
-                     "</div><div class=\"todo-task\">"
-                     "<p>%s</p>"
-                     "</div></div>"
-                     "<div class=\"todo-buttons\">"
-                     "<button type=\"button\" class=\"edit-btn\">✏️</button>"
-                     "<button type=\"button\" class=\"complete-btn\">✅</button>"
-                     "</div></div>",
-                     todos[i].summary,
-                     todos[i].task);
-    }
-
-    p += sprintf(p,
-                 "<div class=\"pagination-info\">"
-                 "<p>Page %d of %d</p>"
-                 "<p>Showing %d-%d of %d To-Dos</p>"
-                 "</div>"
-                 "<div class=\"pagination-controls\">",
-                 page, total_pages,
-                 (page - 1) * PAGE_SIZE + 1,
-                 (page - 1) * PAGE_SIZE + count,
-                 total_count
-    );
-
-    if (page > 1) {
-        p += sprintf(p, "<button><a href=\"/?page=%d\">Previous</a></button>", page - 1);
-    }
-    if (page < total_pages) {
-        p += sprintf(p, "<button><a href=\"/?page=%d\">Next</a></button>", page + 1);
-    }
-    sprintf(p, "</div>");
-
-    size_t template_len = strlen(template);
-    size_t csrf_len = strlen(csrf_html);
-    size_t csrf_rem_len = strlen(csrf_remainder);
-    size_t todos_len = count > 0 ? strlen(todos_html) : 0;
-    size_t todos_rem_len = strlen(todos_remainder);
-    size_t total_len = template_len + csrf_len + csrf_rem_len + todos_len + todos_rem_len;
-    char content_length[64];
-    snprintf(content_length, sizeof(content_length), "Content-Length: %ld\r\n", total_len);
-
-    send_headers(client_socket, 200, "text/html", content_length);
-    send(client_socket, template, template_len, 0);
-    send(client_socket, csrf_html, csrf_len, 0);
-    send(client_socket, csrf_remainder, csrf_rem_len, 0);
-    if (count != 0) {
-        send(client_socket, todos_html, todos_len, 0);
-    }
-    send(client_socket, todos_remainder, todos_rem_len, 0);
-
-    free(template);
-    free(todos_html);
+        append_todo_item(html, &todos[i]);
+    }
+    builder_append_literal(html, "<div class=\"pagination-info\"><p>Page ");
+    builder_append_int(html, page);
+    builder_append_literal(html, " of ");
+    builder_append_int(html, total_pages);
+    builder_append_literal(html, "</p><p>Showing ");
+    builder_append_int(html, (page - 1) * PAGE_SIZE + 1);
+    builder_append_literal(html, "-");
+    builder_append_int(html, (page - 1) * PAGE_SIZE + count);
+    builder_append_literal(html, " of ");
+    builder_append_int(html, total_count);
+    builder_append_literal(html, " To-Dos</p></div><div class=\"pagination-controls\">");
+    // the first page is always the newest todos, whichever way it's reached
+    if (page == 2) {
+        builder_append_literal(html, "<button><a href=\"/\">Previous</a></button>");
+    } else if (page > 2) {
+        append_page_link(html, "Previous", count > 0 ? "before" : NULL, count > 0 ? todos[0].id : 0, page - 1);
+    }
+    if (page < total_pages && count > 0) {
+        append_page_link(html, "Next", "after", todos[count - 1].id, page + 1);
+    }
+    builder_append_literal(html, "</div>");
+    if (html->failed) {
+        response_stream_abort(&stream);
+        template_release(template);
+        free_todos(todos, count);
+        return;
+    }
+
+    response_stream_write(&stream, html->data, html->length);
+    response_stream_write(&stream, template->literals[2].ptr, template->literals[2].len);
+    response_stream_end(&stream);
+
+    template_release(template);
     free_todos(todos, count);
 }
 
@@ -262,7 +352,7 @@ static void create_todo(HttpRequest *req, Task *context) {
     char csrf_token[MAX_TOKEN_LENGTH + 1];
     int user_id;
 
-    QueryResult qres = check_session(req->headers, context->db_conn, &user_id, csrf_token);
+    QueryResult qres = check_session(req, context->db_conn, &user_id, csrf_token);
     if (qres == QRESULT_NONE_AFFECTED) {
         send_error_message(client_socket, 401, "Authentication required.");
         return;
@@ -270,9 +360,9 @@ static void create_todo(HttpRequest *req, Task *context) {
         send_error_message(client_socket, 500, "Couldn't retrieve session information.");
         return;
     }
-    const char *body = req->body;
+    Slice body = req->body;
 
-    if (strstr(req->headers, "\r\nContent-Type: application/x-www-form-urlencoded\r\n") == NULL) {
+    if (!is_form_urlencoded(req)) {
         send_error_message(client_socket, 415, "Content-Type should be set to application/x-www-form-urlencoded.");
         return;
     } else if (!check_csrf_token(req, csrf_token)) {
@@ -331,7 +421,7 @@ static void update_todo(HttpRequest *req, Task *context) {
     char csrf_token[MAX_TOKEN_LENGTH + 1];
     int user_id;
 
-    QueryResult qres = check_session(req->headers, context->db_conn, &user_id, csrf_token);
+    QueryResult qres = check_session(req, context->db_conn, &user_id, csrf_token);
     if (qres == QRESULT_NONE_AFFECTED) {
         send_error_message(client_socket, 401, "Authentication required.");
         return;
@@ -339,20 +429,20 @@ static void update_todo(HttpRequest *req, Task *context) {
         send_error_message(client_socket, 500, "Couldn't retrieve session information.");
         return;
     }
-    const char *body = req->body;
+    Slice body = req->body;
 
-    if (strstr(req->headers, "\r\nContent-Type: application/x-www-form-urlencoded\r\n") == NULL) {
+    if (!is_form_urlencoded(req)) {
         send_error_message(client_socket, 415, "Content-Type should be set to application/x-www-form-urlencoded.");
         return;
     } else if (!check_csrf_token(req, csrf_token)) {
         send_error_message(client_socket, 403, "No CSRF token found.");
         return;
-    } else if (strlen(req->path) == 6) {
+    } else if (req->path.len == 6) {
         send_error_message(client_socket, 400, "Expected to-do ID in the URL.");
         return;
     }
     int id;
-    if (!validate_url_id(req->path + 6, &id)) {
+    if (!validate_url_id(slice_skip(req->path, 6), &id)) {
         send_error_message(client_socket, 400, "Invalid to-do ID.");
         return;
     }
@@ -410,7 +500,7 @@ static void delete_todo(HttpRequest *req, Task *context) {
     char csrf_token[MAX_TOKEN_LENGTH + 1];
     int user_id;
 
-    QueryResult qres = check_session(req->headers, context->db_conn, &user_id, csrf_token);
+    QueryResult qres = check_session(req, context->db_conn, &user_id, csrf_token);
     if (qres == QRESULT_NONE_AFFECTED) {
         send_error_message(client_socket, 401, "Authentication required.");
         return;
@@ -422,12 +512,12 @@ static void delete_todo(HttpRequest *req, Task *context) {
     if (!check_csrf_token(req, csrf_token)) {
         send_error_message(client_socket, 403, "No CSRF token found.");
         return;
-    } else if (strlen(req->path) == 6) {
+    } else if (req->path.len == 6) {
         send_error_message(client_socket, 400, "Expected to-do ID in the URL.");
         return;
     }
     int id;
-    if (!validate_url_id(req->path + 6, &id)) {
+    if (!validate_url_id(slice_skip(req->path, 6), &id)) {
         send_error_message(client_socket, 400, "Invalid to-do ID.");
         return;
     }
@@ -448,7 +538,7 @@ static void get_user_page(HttpRequest *req, Task *context) {
     char csrf_token[MAX_TOKEN_LENGTH + 1];
     int user_id;
 
-    QueryResult qres = check_session(req->headers, context->db_conn, &user_id, csrf_token);
+    QueryResult qres = check_session(req, context->db_conn, &user_id, csrf_token);
     if (qres == QRESULT_NONE_AFFECTED) {
         const char *location = "Location: /user/auth\r\n";
         send_headers(client_socket, 303, NULL, location);
@@ -458,61 +548,41 @@ static void get_user_page(HttpRequest *req, Task *context) {
         return;
     }
 
-    char email[129];
-    if (!db_get_user_email(context->db_conn, user_id, email)) {
-        try_sending_error_file(client_socket, 500);
-        return;
-    }
-
-    char *csrf_remainder;
-    const char *template_path = DOCUMENT_ROOT"/templates/user_page.html";
-    char *template = read_template(template_path, "<!-- CSRF_TOKEN -->", &csrf_remainder);
-
+    Template *template = template_acquire(TEMPLATE_USER_PAGE);
     if (!template) {
         try_sending_error_file(client_socket, 500);
         return;
     }
 
-    char csrf_html[164];
-    sprintf(csrf_html, "<meta name=\"csrf-token\" content=\"%s\">", csrf_token);
+    ResponseStream stream;
+    response_stream_start(&stream, client_socket, req, 200, "text/html");
+    response_stream_write(&stream, template->literals[0].ptr, template->literals[0].len);
+    write_csrf_meta(&stream, csrf_token);
+    response_stream_write(&stream, template->literals[1].ptr, template->literals[1].len);
+    response_stream_flush(&stream);
 
-    char *email_remainder;
-    skip_placeholder(csrf_remainder, "<!-- USER_EMAIL -->", &email_remainder);
-    if (*email_remainder == '\0') {
-        try_sending_error_file(client_socket, 500);
+    char email[129];
+    if (!db_get_user_email(context->db_conn, user_id, email)) {
+        response_stream_abort(&stream);
+        template_release(template);
         return;
     }
 
-    char *email_html = malloc(MAX_TEMPLATE_SIZE + 128);
-    sprintf(email_html, "%s", email);
+    StringBuilder *html = string_builder_get();
+    builder_append_escaped_str(html, email);
+    response_stream_write(&stream, html->data, html->length);
+    response_stream_write(&stream, template->literals[2].ptr, template->literals[2].len);
+    response_stream_end(&stream);
 
-    size_t template_len = strlen(template);
-    size_t csrf_len = strlen(csrf_html);
-    size_t csrf_rem_len = strlen(csrf_remainder);
-    size_t email_len = strlen(email_html);
-    size_t email_rem_len = strlen(email_remainder);
-    size_t total_len = template_len + csrf_len + csrf_rem_len + email_len + email_rem_len;
-    char content_length[64];
-    snprintf(content_length, sizeof(content_length), "Content-Length: %ld\r\n", total_len);
-
-
-    send_headers(client_socket, 200, "text/html", content_length);
-    send(client_socket, template, template_len, 0);
-    send(client_socket, csrf_html, csrf_len, 0);
-    send(client_socket, csrf_remainder, csrf_rem_len, 0);
-    send(client_socket, email_html, email_len, 0);
-    send(client_socket, email_remainder, email_rem_len, 0);
-
-    free(template);
-    free(email_html);
+    template_release(template);
 }
 
 
 static void verify_email(HttpRequest *req, Task *context) {
     int client_socket = context->client_socket;
-    const char *body = req->body;
+    Slice body = req->body;
 
-    if (strstr(req->headers, "Content-Type: application/x-www-form-urlencoded") == NULL) {
+    if (!is_form_urlencoded(req)) {
         send_error_message(client_socket, 415, "Content-Type should be set to application/x-www-form-urlencoded.");
         return;
     }
@@ -567,7 +637,7 @@ static void verify_email(HttpRequest *req, Task *context) {
 
 static void get_verification_page(HttpRequest *req, Task *context) {
     int client_socket = context->client_socket;
-    const char *query_string = req->query_string;
+    Slice query_string = req->query_string;
     const char *expected_keys[] = {"v"};
     bool found_keys[1];
     memset(found_keys, 0, sizeof(found_keys));
@@ -581,59 +651,56 @@ static void get_verification_page(HttpRequest *req, Task *context) {
     extract_url_param(query_string, "v", token, MAX_TOKEN_LENGTH);
     VerificationResult result = {.token = token};
 
-    char *remainder;
-    const char *template_path = DOCUMENT_ROOT"/templates/verification_page.html";
-    char *template = read_template(template_path, "<!-- RESULT_BODY -->", &remainder);
-
-    if (!template) {
-        try_sending_error_file(client_socket, 500);
-        return;
-    }
-
     QueryResult qres = db_get_verification_result(context->db_conn, &result);
     if (qres == QRESULT_INTERNAL_ERROR) {
         try_sending_error_file(client_socket, 500);
-        free(template);
         return;
     } else if (qres == QRESULT_NONE_AFFECTED) {
         try_sending_error_file(client_socket, 404);
-        free(template);
         return;
     }
 
     if (result.expires_at < time(NULL)) {
         try_sending_error_file(client_socket, 404);
-        free(template);
         return;
     }
-    char *result_html = malloc(MAX_TEMPLATE_SIZE);
-    sprintf(result_html, "<h2>Verification %s</h2>"
-                         "<p>%s</p>",
-            result.success ? "successful!" : "failed...",
-            result.message);
-
-    size_t template_len = strlen(template);
-    size_t result_len = strlen(result_html);
-    size_t remainder_len = strlen(remainder);
-    size_t total_len = template_len + result_len + remainder_len;
-    char content_length[64];
-    snprintf(content_length, sizeof(content_length), "Content-Length: %ld\r\n", total_len);
+    Template *template = template_acquire(TEMPLATE_VERIFICATION_PAGE);
+    if (!template) {
+        try_sending_error_file(client_socket, 500);
+        return;
+    }
+    StringBuilder *html = string_builder_get();
+    builder_append_literal(html, "<h2>Verification ");
+    if (result.success) {
+        builder_append_literal(html, "successful!");
+    } else {
+        builder_append_literal(html, "failed...");
+    }
+    builder_append_literal(html, "</h2><p>");
+    builder_append_escaped_str(html, result.message);
+    builder_append_literal(html, "</p>");
+    if (html->failed) {
+        try_sending_error_file(client_socket, 500);
+        template_release(template);
+        return;
+    }
 
-    send_headers(client_socket, 200, "text/html", content_length);
-    send(client_socket, template, template_len, 0);
-    send(client_socket, result_html, result_len, 0);
-    send(client_socket, remainder, remainder_len, 0);
+    Response response;
+    response_init(&response, client_socket, 200, "text/html");
+    response_add_body(&response, template->literals[0].ptr, template->literals[0].len);
+    response_add_body(&response, html->data, html->length);
+    response_add_body(&response, template->literals[1].ptr, template->literals[1].len);
+    response_send(&response);
 
-    free(result_html);
-    free(template);
+    template_release(template);
 }
 
 
 static void verify_new_email(HttpRequest *req, Task *context) {
     int client_socket = context->client_socket;
-    const char *body = req->body;
+    Slice body = req->body;
 
-    if (strstr(req->headers, "Content-Type: application/x-www-form-urlencoded") == NULL) {
+    if (!is_form_urlencoded(req)) {
         send_error_message(client_socket, 415, "Content-Type should be set to application/x-www-form-urlencoded.");
         return;
     }
@@ -708,7 +775,7 @@ static void verify_new_email(HttpRequest *req, Task *context) {
 static void forgot_password(HttpRequest *req, Task *context) {
     int client_socket = context->client_socket;
 
-    if (strstr(req->headers, "Content-Type: application/x-www-form-urlencoded") == NULL) {
+    if (!is_form_urlencoded(req)) {
         send_error_message(client_socket, 415, "Content-Type should be set to application/x-www-form-urlencoded.");
         return;
     }
@@ -739,13 +806,13 @@ static void forgot_password(HttpRequest *req, Task *context) {
     }
 
     if (SEND_EMAILS) {
-        const char *reset_filepath = DOCUMENT_ROOT"/mails/password_reset.html";
-        char reset_link[256 + MAX_TOKEN_LENGTH];
-        snprintf(reset_link, sizeof(reset_link),
-                 "<a href=\"%s/user/reset-password?v=%s\">Click Here</a>",
-                 SERVER_DOMAIN, token);
+        StringBuilder *reset_link = string_builder_get();
+        builder_append_literal(reset_link, "<a href=\"" SERVER_DOMAIN "/user/reset-password?v=");
+        builder_append_escaped_str(reset_link, token);
+        builder_append_literal(reset_link, "\">Click Here</a>");
 
-        if (!send_email(email, "Reset Your password", reset_filepath, "<!-- RESET_LINK -->", reset_link)) {
+        if (reset_link->failed ||
+            !send_email(email, "Reset Your password", TEMPLATE_PASSWORD_RESET, reset_link->data)) {
             send_error_message(client_socket, 500, "Couldn't send an e-mail for resetting password.");
             return;
         }
@@ -757,7 +824,7 @@ static void forgot_password(HttpRequest *req, Task *context) {
 
 static void get_reset_password_page(HttpRequest *req, Task *context) {
     int client_socket = context->client_socket;
-    const char *query_string = req->query_string;
+    Slice query_string = req->query_string;
     const char *expected_keys[] = {"v"};
     bool found_keys[1];
     memset(found_keys, 0, sizeof(found_keys));
@@ -779,34 +846,38 @@ static void get_reset_password_page(HttpRequest *req, Task *context) {
         return;
     }
 
-    const char *reset_pswd_path = DOCUMENT_ROOT"/reset_password_page.html";
-    char *remainder;
-    char *reset_html = read_template(reset_pswd_path, "<!-- V_TOKEN -->", &remainder);
-
-    char token_html[256 + MAX_TOKEN_LENGTH];
-    snprintf(token_html, sizeof(token_html), "<input type=\"hidden\" name=\"vtoken\" value=\"%s\">", token);
+    Template *template = template_acquire(TEMPLATE_RESET_PASSWORD_PAGE);
+    if (!template) {
+        try_sending_error_file(client_socket, 500);
+        return;
+    }
 
-    size_t reset_len = strlen(reset_html);
-    size_t token_len = strlen(token_html);
-    size_t remainder_len = strlen(remainder);
-    size_t total_len = reset_len + token_len + remainder_len;
-    char content_length[total_len + 1];
-    snprintf(content_length, sizeof(content_length), "Content-Length: %ld\r\n", total_len);
+    StringBuilder *html = string_builder_get();
+    builder_append_literal(html, "<input type=\"hidden\" name=\"vtoken\" value=\"");
+    builder_append_escaped_str(html, token);
+    builder_append_literal(html, "\">");
+    if (html->failed) {
+        try_sending_error_file(client_socket, 500);
+        template_release(template);
+        return;
+    }
 
-    send_headers(client_socket, 200, "text/html", content_length);
-    send(client_socket, reset_html, reset_len, 0);
-    send(client_socket, token_html, token_len, 0);
-    send(client_socket, remainder, remainder_len, 0);
+    Response response;
+    response_init(&response, client_socket, 200, "text/html");
+    response_add_body(&response, template->literals[0].ptr, template->literals[0].len);
+    response_add_body(&response, html->data, html->length);
+    response_add_body(&response, template->literals[1].ptr, template->literals[1].len);
+    response_send(&response);
 
-    free(reset_html);
+    template_release(template);
 }
 
 
 static void reset_password(HttpRequest *req, Task *context) {
     int client_socket = context->client_socket;
-    const char *body = req->body;
+    Slice body = req->body;
 
-    if (strstr(req->headers, "Content-Type: application/x-www-form-urlencoded") == NULL) {
+    if (!is_form_urlencoded(req)) {
         send_error_message(client_socket, 415, "Content-Type should be set to application/x-www-form-urlencoded.");
         return;
     }
@@ -854,11 +925,24 @@ static void reset_password(HttpRequest *req, Task *context) {
 }
 
 
+// the form a verification mail submits back to action
+static void append_verification_form(StringBuilder *html, const char *action, const char *email, const char *token) {
+    builder_append_literal(html, "<form action=\"" SERVER_DOMAIN);
+    builder_append(html, action, strlen(action));
+    builder_append_literal(html, "\" method=\"POST\" enctype=\"application/x-www-form-urlencoded\">"
+                                 "<input type=\"hidden\" name=\"email\" value=\"");
+    builder_append_escaped_str(html, email);
+    builder_append_literal(html, "\"><input type=\"hidden\" name=\"vtoken\" value=\"");
+    builder_append_escaped_str(html, token);
+    builder_append_literal(html, "\"><button type=\"submit\">Click Here</button></form>");
+}
+
+
 static void signup_user(HttpRequest *req, Task *context) {
     int client_socket = context->client_socket;
-    const char *body = req->body;
+    Slice body = req->body;
 
-    if (strstr(req->headers, "Content-Type: application/x-www-form-urlencoded") == NULL) {
+    if (!is_form_urlencoded(req)) {
         send_error_message(client_socket, 415, "Content-Type should be set to application/x-www-form-urlencoded.");
         return;
     }
@@ -905,17 +989,11 @@ static void signup_user(HttpRequest *req, Task *context) {
     }
 
     if (SEND_EMAILS) {
-        const char *verify_filepath = DOCUMENT_ROOT"/mails/email_verification.html";
-        char verification_form[512 + MAX_TOKEN_LENGTH];
-        snprintf(verification_form, sizeof(verification_form),
-                 "<form action=\"%s/user/verify\" method=\"POST\" enctype=\"application/x-www-form-urlencoded\">"
-                 "<input type=\"hidden\" name=\"email\" value=\"%s\">"
-                 "<input type=\"hidden\" name=\"vtoken\" value=\"%s\">"
-                 "<button type=\"submit\">Click Here</button>"
-                 "</form>",
-                 SERVER_DOMAIN, email, verification_token);
-
-        if (!send_email(email, "Verify Your To-Do account", verify_filepath, "<!-- VER_FORM -->", verification_form)) {
+        StringBuilder *verification_form = string_builder_get();
+        append_verification_form(verification_form, "/user/verify", email, verification_token);
+
+        if (verification_form->failed ||
+            !send_email(email, "Verify Your To-Do account", TEMPLATE_EMAIL_VERIFICATION, verification_form->data)) {
             send_error_message(client_socket, 500, "Couldn't send a verification e-mail.");
             return;
         }
@@ -927,9 +1005,9 @@ static void signup_user(HttpRequest *req, Task *context) {
 
 static void login_user(HttpRequest *req, Task *context) {
     int client_socket = context->client_socket;
-    const char *body = req->body;
+    Slice body = req->body;
 
-    if (strstr(req->headers, "Content-Type: application/x-www-form-urlencoded") == NULL) {
+    if (!is_form_urlencoded(req)) {
         send_error_message(client_socket, 415, "Content-Type should be set to application/x-www-form-urlencoded.");
         return;
     }
@@ -995,7 +1073,7 @@ static void logout_user(HttpRequest *req, Task *context) {
     char session_token[MAX_TOKEN_LENGTH + 1];
     int user_id;
 
-    QueryResult qres = check_and_retrieve_session(req->headers, context->db_conn, &user_id, csrf_token, session_token,
+    QueryResult qres = check_and_retrieve_session(req, context->db_conn, &user_id, csrf_token, session_token,
                                                   MAX_TOKEN_LENGTH);
     if (qres == QRESULT_NONE_AFFECTED) {
         send_error_message(client_socket, 401, "Authentication required.");
@@ -1024,7 +1102,7 @@ void update_user(HttpRequest *req, Task *context) {
     char csrf_token[MAX_TOKEN_LENGTH + 1];
     int user_id;
 
-    QueryResult qres = check_session(req->headers, context->db_conn, &user_id, csrf_token);
+    QueryResult qres = check_session(req, context->db_conn, &user_id, csrf_token);
     if (qres == QRESULT_NONE_AFFECTED) {
         send_error_message(client_socket, 401, "Authentication required.");
         return;
@@ -1032,9 +1110,9 @@ void update_user(HttpRequest *req, Task *context) {
         send_error_message(client_socket, 500, "Couldn't retrieve session information.");
         return;
     }
-    const char *body = req->body;
+    Slice body = req->body;
 
-    if (strstr(req->headers, "Content-Type: application/x-www-form-urlencoded") == NULL) {
+    if (!is_form_urlencoded(req)) {
         send_error_message(client_socket, 415, "Content-Type should be set to application/x-www-form-urlencoded.");
         return;
     } else if (!check_csrf_token(req, csrf_token)) {
@@ -1076,18 +1154,11 @@ void update_user(HttpRequest *req, Task *context) {
             return;
         }
         if (SEND_EMAILS) {
-            const char *verify_filepath = DOCUMENT_ROOT"/mails/email_verification.html";
-            char verification_form[512 + MAX_TOKEN_LENGTH];
-            snprintf(verification_form, sizeof(verification_form),
-                     "<form action=\"%s/user/verify-new\" method=\"POST\" enctype=\"application/x-www-form-urlencoded\">"
-                     "<input type=\"hidden\" name=\"email\" value=\"%s\">"
-                     "<input type=\"hidden\" name=\"vtoken\" value=\"%s\">"
-                     "<button type=\"submit\">Click Here</button>"
-                     "</form>",
-                     SERVER_DOMAIN, email, verification_token);
-
-            if (!send_email(email, "Verify Your new To-Do e-mail", verify_filepath, "<!-- VER_FORM -->",
-                            verification_form)) {
+            StringBuilder *verification_form = string_builder_get();
+            append_verification_form(verification_form, "/user/verify-new", email, verification_token);
+
+            if (verification_form->failed || !send_email(email, "Verify Your new To-Do e-mail",
+                                                         TEMPLATE_EMAIL_VERIFICATION, verification_form->data)) {
                 send_error_message(client_socket, 500, "Couldn't send a verification e-mail.");
                 return;
             }
@@ -1112,7 +1183,7 @@ void delete_user(HttpRequest *req, Task *context) {
     char csrf_token[MAX_TOKEN_LENGTH + 1];
     int user_id;
 
-    QueryResult qres = check_session(req->headers, context->db_conn, &user_id, csrf_token);
+    QueryResult qres = check_session(req, context->db_conn, &user_id, csrf_token);
     if (qres == QRESULT_NONE_AFFECTED) {
         send_error_message(client_socket, 401, "Authentication required.");
         return;
@@ -1136,8 +1207,9 @@ void delete_user(HttpRequest *req, Task *context) {
 
 bool needs_db_conn(HttpRequest *req) {
     if (req->method != GET) return true;
-    if (strcmp(req->path, "/about") == 0) return false;
-    if (strcmp(req->path, "/user/auth") == 0) return false;
+    if (!check_route(req->path, GET)) return false;                             // static files
+    if (slice_equals(req->path, "/about")) return false;
+    if (slice_equals(req->path, "/user/auth")) return false;
     return true;
 }
 
@@ -1152,6 +1224,9 @@ void handle_http_request(HttpRequest *req, Task *context) {
 
     const Route *route = check_route(req->path, req_method);
     if (route) {                                                                // routed files
+        context->conn->compressible = route->compress;
+        context->conn->accepts_gzip = route->compress &&
+                                      negotiate_encoding(req, ENCODING_BIT(ENCODING_GZIP)) == ENCODING_GZIP;
         route->handler(req, context);
         return;
     } else {                                                                    // static files
@@ -1159,12 +1234,15 @@ void handle_http_request(HttpRequest *req, Task *context) {
             try_sending_error_file(client_socket, 405);
             return;
         }
+        if (try_sending_cached_file(client_socket, req)) {
+            return;
+        }
         char file_path[MAX_PATH_LENGTH];
-        snprintf(file_path, sizeof(file_path), "%s/static%s", DOCUMENT_ROOT, req->path);
+        snprintf(file_path, sizeof(file_path), "%s/static%.*s", DOCUMENT_ROOT, (int)req->path.len, req->path.ptr);
         if (!is_path_safe(file_path)) {
             try_sending_error_file(client_socket, 404);
             return;
         }
-        try_sending_file(client_socket, file_path);
+        try_sending_file(client_socket, req, file_path);
     }
 }
\ No newline at end of file
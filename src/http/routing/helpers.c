@@ -1,7 +1,9 @@
 #include "helpers.h"
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <limits.h>
 #include "../../db/todos.h"
 #include "../../db/users.h"
 #include <curl/curl.h>
@@ -33,7 +35,7 @@ static size_t read_callback(char *ptr, size_t size, size_t nmemb, void *userp) {
 }
 
 
-bool send_email(const char *to, const char *subject, const char *template_file, const char *placeholder, const char *body) {
+bool send_email(const char *to, const char *subject, TemplateId template_id, const char *body) {
     CURL *curl;
     CURLcode res = CURLE_OK;
     struct curl_slist *recipients = NULL;
@@ -48,9 +50,8 @@ bool send_email(const char *to, const char *subject, const char *template_file,
         return false;
     }
 
-    char *remainder = NULL;
-    char *html_content = read_template(template_file, placeholder, &remainder);
-    if (!html_content) {
+    Template *template = template_acquire(template_id);
+    if (!template) {
         return false;
     }
 
@@ -61,15 +62,18 @@ bool send_email(const char *to, const char *subject, const char *template_file,
         "MIME-Version: 1.0\r\n"
         "Content-Type: text/html; charset=UTF-8\r\n"
         "\r\n"
-        "%s%s%s";
+        "%.*s%s%.*s";
 
-    size_t full_email_size = strlen(email_template) + strlen(to) + strlen(sender) + strlen(subject) + strlen(html_content) + strlen(body) + strlen(remainder) + 1;
+    size_t full_email_size = strlen(email_template) + strlen(to) + strlen(sender) + strlen(subject) + template->literals[0].len + strlen(body) + template->literals[1].len + 1;
     char *full_email = malloc(full_email_size);
     if (!full_email) {
-        free(html_content);
+        template_release(template);
         return false;
     }
-    snprintf(full_email, full_email_size, email_template, to, sender, subject, html_content, body, remainder);
+    snprintf(full_email, full_email_size, email_template, to, sender, subject,
+             (int)template->literals[0].len, template->literals[0].ptr, body,
+             (int)template->literals[1].len, template->literals[1].ptr);
+    template_release(template);
 
     struct upload_status upload_ctx = { full_email, 0 };
 
@@ -103,7 +107,7 @@ bool send_email(const char *to, const char *subject, const char *template_file,
         curl_easy_cleanup(curl);
     }
 
-    free(html_content);
+    free(full_email);
     return res == CURLE_OK;
 }
 
@@ -139,90 +143,81 @@ static void url_decode(const char *src, size_t src_len, char *dest) {
 }
 
 
-bool extract_url_param(const char *src, const char *key, char *dest, int max_len) {
-    char search_key[256];
-    snprintf(search_key, sizeof(search_key), "%s=", key);
+// finds the next key=value pair of a url-encoded string, returning false once there are none left
+static bool next_url_pair(const char **cursor, const char *end, Slice *key, Slice *value) {
+    while (*cursor < end) {
+        const char *pair = *cursor;
+        const char *pair_end = memchr(pair, '&', end - pair);
+        if (!pair_end) pair_end = end;
+        *cursor = pair_end < end ? pair_end + 1 : end;
 
-    char *start = strstr(src, search_key);
-    if (!start) return NULL;
-    start += strlen(search_key);
-
-    char *end = strchr(start, '&');
-    if (!end) end = start + strlen(start);
-
-    size_t len = end - start;
-    if (len > max_len) {
-        dest[0] = '\0';
-        return false;
+        if (pair_end == pair) continue;
+        const char *separator = memchr(pair, '=', pair_end - pair);
+        *key = (Slice) {pair, separator ? (size_t)(separator - pair) : (size_t)(pair_end - pair)};
+        *value = separator ? (Slice) {separator + 1, pair_end - separator - 1} : (Slice) {pair_end, 0};
+        return true;
     }
-    char encoded[len + 1];
-    strncpy(encoded, start, len);
-    encoded[len] = '\0';
-
-    url_decode(encoded, len, dest);
-    return true;
+    return false;
 }
 
 
-void skip_placeholder(char *buffer, const char *placeholder, char **remainder) {
-    char *placeholder_pos = strstr(buffer, placeholder);
-    if (placeholder_pos) {
-        *placeholder_pos = '\0';
-        *remainder = placeholder_pos + strlen(placeholder);
-    } else {
-        *remainder = buffer + strlen(buffer);
-    }
-}
+bool extract_url_param(Slice src, const char *key, char *dest, int max_len) {
+    const char *cursor = src.ptr;
+    const char *end = src.ptr + src.len;
+    Slice pair_key, value;
 
+    while (next_url_pair(&cursor, end, &pair_key, &value)) {
+        if (!slice_equals(pair_key, key)) continue;
 
-char *read_template(const char *filename, const char *placeholder, char **remainder) {
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
-        perror("Error opening template file");
-        return NULL;
+        if (value.len > max_len) {
+            dest[0] = '\0';
+            return false;
+        }
+        url_decode(value.ptr, value.len, dest);
+        return true;
     }
-
-    char *buffer = malloc(MAX_TEMPLATE_SIZE);
-    size_t bytesRead = fread(buffer, 1, MAX_TEMPLATE_SIZE - 1, file);
-    buffer[bytesRead] = '\0';
-
-    fclose(file);
-
-    skip_placeholder(buffer, placeholder, remainder);
-
-    return buffer;
+    return false;
 }
 
 
-bool parse_url_data(const char *body, const char **expected_keys, int n_expected_keys, bool *found_keys) {
-    if (!body) return false;
+bool parse_url_data(Slice body, const char **expected_keys, int n_expected_keys, bool *found_keys) {
+    if (body.len == 0) return false;
 
-    char *body_copy = strdup(body);
-    char *token, *rest = body_copy;
-    while ((token = strtok_r(rest, "&", &rest))) {
-        char *key = strtok(token, "=");
-        char *value = strtok(NULL, "=");
+    const char *cursor = body.ptr;
+    const char *end = body.ptr + body.len;
+    Slice key, value;
+    while (next_url_pair(&cursor, end, &key, &value)) {
+        if (key.len == 0 || value.len == 0) continue;
 
-        if (key && value) {
-            bool is_expected = false;
-            for (int i = 0; i < n_expected_keys; ++i) {
-                if (strcmp(key, expected_keys[i]) == 0) {
-                    found_keys[i] = true;
-                    is_expected = true;
-                    break;
-                }
-            }
-            if (!is_expected) {
-                free(body_copy);
-                return false;
+        bool is_expected = false;
+        for (int i = 0; i < n_expected_keys; ++i) {
+            if (slice_equals(key, expected_keys[i])) {
+                found_keys[i] = true;
+                is_expected = true;
+                break;
             }
         }
+        if (!is_expected) {
+            return false;
+        }
     }
-    free(body_copy);
     return true;
 }
 
 
+bool is_form_urlencoded(const HttpRequest *req) {
+    Slice content_type = request_header(req, HDR_CONTENT_TYPE);
+    size_t length = content_type.len;
+    // parameters like a charset don't change how the body is encoded
+    const char *parameters = content_type.ptr ? memchr(content_type.ptr, ';', content_type.len) : NULL;
+    if (parameters) {
+        length = parameters - content_type.ptr;
+        while (length > 0 && (content_type.ptr[length - 1] == ' ' || content_type.ptr[length - 1] == '\t')) length--;
+    }
+    return length == 33 && strncasecmp(content_type.ptr, "application/x-www-form-urlencoded", 33) == 0;
+}
+
+
 int is_path_safe(const char *path) {
     char resolved_path[MAX_PATH_LENGTH];
     char resolved_root[MAX_PATH_LENGTH];
@@ -239,18 +234,22 @@ int is_path_safe(const char *path) {
 }
 
 
-bool validate_url_id(const char *url_id, int *id) {
-    size_t url_len = strlen(url_id);
-    for (int i = 0; i < url_len; ++i) {
-        if (!isdigit(*(url_id + i))) {
+bool validate_url_id(Slice url_id, int *id) {
+    if (url_id.len == 0 || url_id.len > 10) {
+        return false;
+    }
+    long value = 0;
+    for (size_t i = 0; i < url_id.len; ++i) {
+        if (!isdigit(url_id.ptr[i])) {
             return false;
         }
+        value = value * 10 + (url_id.ptr[i] - '0');
     }
 
-    *id = atoi(url_id);
-    if (*id < 0 || (*id == 0 && strcmp(url_id, "0") != 0)) {
+    if (value > INT_MAX) {
         return false;
     }
+    *id = (int)value;
     return true;
 }
 
@@ -2,25 +2,23 @@
 #define HTTP_SERVER_HELPERS_H
 
 #include "route.h"
+#include "../templates.h"
 
-#define MAX_TEMPLATE_SIZE 8192
 #define MAX_PATH_LENGTH 304
 #define DOCUMENT_ROOT "../src/http/www"
 
 
-bool send_email(const char *to, const char *subject, const char *template_file, const char *placeholder, const char *body);
+bool send_email(const char *to, const char *subject, TemplateId template_id, const char *body);
 
-bool extract_url_param(const char *src, const char *key, char *dest, int max_len);
+bool extract_url_param(Slice src, const char *key, char *dest, int max_len);
 
-void skip_placeholder(char *buffer, const char *placeholder, char **remainder);
+bool parse_url_data(Slice body, const char **expected_keys, int n_expected_keys, bool *found_keys);
 
-char *read_template(const char *filename, const char *placeholder, char **remainder);
-
-bool parse_url_data(const char *body, const char **expected_keys, int n_expected_keys, bool *found_keys);
+bool is_form_urlencoded(const HttpRequest *req);
 
 int is_path_safe(const char *path);
 
-bool validate_url_id(const char *url_id, int *id);
+bool validate_url_id(Slice url_id, int *id);
 
 bool is_valid_email(const char *email);
 
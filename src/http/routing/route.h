@@ -5,10 +5,13 @@
 #include "../util/task.h"
 
 
+// compress marks pages worth gzipping on the fly; pages that echo the query string next to a secret stay off it,
+// as compression would leak the secret through the response length
 typedef struct {
     const char *url;
     Method method;
     void (*handler)(HttpRequest *, Task *);
+    bool compress;
 } Route;
 
 
@@ -1,6 +1,13 @@
 #include "server.h"
 #include "routing/handlers.h"
 #include "util/db_cleanup.h"
+#include "tokenizer.h"
+#include "headers.h"
+#include "static_cache.h"
+#include "error_responses.h"
+#include "templates.h"
+#include "routing/helpers.h"
+#include "../db/util/statements.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,13 +15,13 @@
 #include <errno.h>
 #include <pthread.h>
 #include <signal.h>
-#include <ctype.h>
 #include <time.h>
+#include <limits.h>
 
 #define MAX_RETRIES 10
 #define INITIAL_RETRY_DELAY_MS 100
 #define MAX_RETRY_DELAY_MS 10000
-#define MAX_QUEUE_SIZE 100
+#define MAX_QUEUE_SIZE 1024
 #define DB_CONN_WAIT_TIMEOUT_MS 10000
 
 
@@ -33,6 +40,44 @@ static void signal_handler(int signum) {
 }
 
 
+static int env_to_int(const char *name, int default_value) {
+    char *value = getenv(name);
+    if (!value || *value == '\0') {
+        return default_value;
+    }
+    char *end;
+    long number = strtol(value, &end, 10);
+    if (*end != '\0' || number < 0 || number > INT_MAX) {
+        fprintf(stderr, "Invalid value of %s, using %d\n", name, default_value);
+        return default_value;
+    }
+    return (int)number;
+}
+
+
+static void load_server_config(ServerConfig *config) {
+    config->request_timeout = env_to_int("REQUEST_TIMEOUT", DEFAULT_REQUEST_TIMEOUT);
+    config->keep_alive_timeout = env_to_int("KEEP_ALIVE_TIMEOUT", DEFAULT_KEEP_ALIVE_TIMEOUT);
+    config->keep_alive_max_requests = env_to_int("KEEP_ALIVE_MAX_REQUESTS", DEFAULT_KEEP_ALIVE_MAX_REQUESTS);
+    config->listeners = env_to_int("LISTENERS", DEFAULT_LISTENERS);
+    config->listen_backlog = env_to_int("LISTEN_BACKLOG", DEFAULT_LISTEN_BACKLOG);
+    config->static_cache_size = env_to_int("STATIC_CACHE_SIZE", DEFAULT_STATIC_CACHE_SIZE);
+
+    // 0 listeners means one per online core
+    if (config->listeners == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        config->listeners = cores > 0 ? (int)cores : 1;
+    }
+    if (config->listeners > MAX_LISTENERS) {
+        config->listeners = MAX_LISTENERS;
+    }
+    // a new connection always gets a moment to send its first request, KEEP_ALIVE_TIMEOUT=0 only turns keep-alive off
+    if (config->request_timeout == 0) {
+        config->request_timeout = DEFAULT_REQUEST_TIMEOUT;
+    }
+}
+
+
 static PGconn *connect_to_db() {
     char *db_name = getenv("DB_NAME");
     char *db_user = getenv("DB_USER");
@@ -91,7 +136,10 @@ bool init_connection_pool(ConnectionPool *pool) {
 
     for (int i = 0; i < CONN_POOL_SIZE; ++i) {
         pool->connections[i].conn = connect_to_db();
-        if (!pool->connections[i].conn) {
+        if (!pool->connections[i].conn || !prepare_statements(pool->connections[i].conn)) {
+            if (pool->connections[i].conn) {
+                PQfinish(pool->connections[i].conn);
+            }
             for (int j = i - 1; j >= 0; --j) {
                 PQfinish(pool->connections[j].conn);
             }
@@ -103,17 +151,37 @@ bool init_connection_pool(ConnectionPool *pool) {
 }
 
 
+// a connection the database dropped, or one a failed query batch left in pipeline mode, is reset before it's handed
+// out, which also loses its prepared statements
+static void revive_connection(PGconn *conn) {
+    if (PQstatus(conn) == CONNECTION_OK && PQpipelineStatus(conn) == PQ_PIPELINE_OFF) {
+        return;
+    }
+    PQreset(conn);
+    if (PQstatus(conn) != CONNECTION_OK) {
+        fprintf(stderr, "Failed to reset the database connection: %s", PQerrorMessage(conn));
+        return;
+    }
+    prepare_statements(conn);
+}
+
+
 PGconn *get_connection(ConnectionPool *pool) {
+    PGconn *conn = NULL;
     pthread_mutex_lock(&pool->mutex);
     for (int i = 0; i < CONN_POOL_SIZE; ++i) {
         if (!pool->connections[i].in_use) {
             pool->connections[i].in_use = true;
-            pthread_mutex_unlock(&pool->mutex);
-            return pool->connections[i].conn;
+            conn = pool->connections[i].conn;
+            break;
         }
     }
     pthread_mutex_unlock(&pool->mutex);
-    return NULL;
+
+    if (conn) {
+        revive_connection(conn);
+    }
+    return conn;
 }
 
 
@@ -139,15 +207,18 @@ void cleanup_connection_pool(ConnectionPool *pool) {
 }
 
 
-static void enqueue_task(Task task) {
+static bool enqueue_task(Task task) {
+    bool queued = false;
     pthread_mutex_lock(&queue_mutex);
     if (queue_size < MAX_QUEUE_SIZE) {
         queue_rear = (queue_rear + 1) % MAX_QUEUE_SIZE;
         task_queue[queue_rear] = task;
         queue_size++;
+        queued = true;
         pthread_cond_signal(&queue_cond);
     }
     pthread_mutex_unlock(&queue_mutex);
+    return queued;
 }
 
 
@@ -169,153 +240,166 @@ static Task dequeue_task() {
 }
 
 
-static ssize_t receive_full_request(int client_socket, char **request_buffer, size_t *buffer_size) {
-    ssize_t total_bytes = 0;
-    ssize_t bytes_received;
-    size_t content_length = 0;
-    bool headers_end = false;
-    char *header_end = NULL;
-
-    while (1) {
-        if (total_bytes + 1024 > *buffer_size) {
-            *buffer_size += 1024;
-            char *new_buffer = realloc(*request_buffer, *buffer_size);
-            if (!new_buffer) {
-                perror("Failed to allocate memory for the new request buffer");
-                return -1;
-            }
-            *request_buffer = new_buffer;
-        }
+static bool dispatch_connection(Connection *conn) {
+    Task task = {conn->client_socket, NULL, conn};
+    return enqueue_task(task);
+}
 
-        bytes_received = recv(client_socket, *request_buffer + total_bytes, *buffer_size - total_bytes - 1, 0);
 
-        if (bytes_received < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                continue;
-            } else {
-                perror("recv failed");
-                return -1;
-            }
-        } else if (bytes_received == 0) {
-            break;
-        }
-
-        total_bytes += bytes_received;
-        (*request_buffer)[total_bytes] = '\0';
-
-        if (!headers_end) {
-            header_end = strstr(*request_buffer, "\r\n\r\n");
-            if (header_end) {
-                headers_end = true;
-                char *content_length_header = strstr(*request_buffer, "Content-Length:");
-                if (content_length_header) {
-                    content_length_header += 15;
-                    while (isspace(*content_length_header)) content_length_header++;
-                    content_length = strtoul(content_length_header, NULL, 10);
+// handles the connection's current request, returns whether the connection stays open afterwards
+static bool serve_request(Server *server, Task *task) {
+    ConnectionPool *connection_pool = &server->conns;
+    Connection *conn = task->conn;
+    HttpRequest *request = &conn->request;
+    int client_socket = task->client_socket;
+
+    conn->requests_served++;
+    conn->keep_alive = keep_running &&
+                       (!conn->read_closed || connection_has_pipelined_request(conn)) &&
+                       server->config.keep_alive_timeout > 0 &&
+                       conn->requests_served < server->config.keep_alive_max_requests &&
+                       request_wants_keep_alive(request);
+    conn->compressible = false;
+    conn->accepts_gzip = false;
+
+    task->db_conn = NULL;
+    if (needs_db_conn(request)) {
+        PGconn *task_conn = get_connection(connection_pool);
+
+        // should only happen when thread pool is bigger than connection pool
+        if (!task_conn) {
+            struct timespec start, now;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+
+            while (!task_conn && keep_running) {
+                task_conn = get_connection(connection_pool);
+                if (!task_conn) {
+                    struct timespec wait_time = {0, 100000000};
+                    nanosleep(&wait_time, NULL);
+
+                    clock_gettime(CLOCK_MONOTONIC, &now);
+                    if ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 > DB_CONN_WAIT_TIMEOUT_MS) {
+                        break;
+                    }
                 }
             }
+            if (!task_conn) {
+                conn->keep_alive = false;
+                try_sending_error_file(client_socket, 503);
+                return false;
+            }
         }
-        if (headers_end && total_bytes >= (size_t)(header_end + 4 - *request_buffer + content_length)) {
-            break;
-        }
+        task->db_conn = task_conn;
     }
-    return total_bytes;
+    handle_http_request(request, task);
+
+    if (task->db_conn) release_connection(connection_pool, task->db_conn);
+    return conn->keep_alive;
 }
 
 
-static void *worker_thread(void *connections) {
-    ConnectionPool *connection_pool = (ConnectionPool *)connections;
+static void *worker_thread(void *server_ptr) {
+    Server *server = (Server *)server_ptr;
     while (keep_running) {
         Task task = dequeue_task();
-        int client_socket = task.client_socket;
-        if (client_socket == -1) {
+        if (task.client_socket == -1) {
             break;
         }
-
-        char *request_buffer = NULL;
-        size_t buffer_size = 0;
-        ssize_t total_bytes = receive_full_request(client_socket, &request_buffer, &buffer_size);
-
-        if (total_bytes > 0) {
-            HttpRequest request;
-            memset(&request, 0, sizeof(HttpRequest));
-
-            RequestParsingStatus status = parse_http_request(request_buffer, &request);
-            if (status == REQ_PARSE_SUCCESS) {
-                if (needs_db_conn(&request)) {
-                    PGconn *task_conn = get_connection(connection_pool);
-
-                    // should only happen when thread pool is bigger than connection pool
-                    if (!task_conn) {
-                        struct timespec start, now;
-                        clock_gettime(CLOCK_MONOTONIC, &start);
-
-                        while (!task_conn && keep_running) {
-                            task_conn = get_connection(connection_pool);
-                            if (!task_conn) {
-                                struct timespec wait_time = {0, 100000000};
-                                nanosleep(&wait_time, NULL);
-
-                                clock_gettime(CLOCK_MONOTONIC, &now);
-                                if ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 > DB_CONN_WAIT_TIMEOUT_MS) {
-                                    break;
-                                }
-                            }
-                        }
-                        if (!task_conn) {
-                            try_sending_error_file(client_socket, 503);
-                            free_http_request(&request);
-                            free(request_buffer);
-                            close(client_socket);
-                            continue;
-                        }
-                    }
-                    task.db_conn = task_conn;
-                }
-                handle_http_request(&request, &task);
-                free_http_request(&request);
-            } else {
-                handle_invalid_http_request(status, client_socket);
+        Connection *conn = task.conn;
+
+        // pipelined requests already buffered are answered right away, in the order they came in
+        bool keep_alive = serve_request(server, &task);
+        while (keep_alive && connection_next_request(conn)) {
+            RequestParsingStatus status = connection_parse_request(conn);
+            if (status != REQ_PARSE_SUCCESS) {
+                conn->keep_alive = keep_alive = false;
+                handle_invalid_http_request(status, conn->client_socket);
+                break;
             }
+            keep_alive = serve_request(server, &task);
+        }
+
+        if (keep_alive) {
+            event_loop_resume(conn);
+        } else {
+            connection_close(conn);
         }
-        free(request_buffer);
-        if (task.db_conn) release_connection(connection_pool, task.db_conn);
-        close(client_socket);
     }
     return NULL;
 }
 
 
-bool server_init(Server *server, int port) {
-    if (!init_connection_pool(&server->conns)) {
-        return false;
+static int open_listener(Server *server, bool reuse_port) {
+    int server_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_socket == -1) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    int reuse = 1;
+    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0) {
+        perror("Failed to set SO_REUSEADDR");
+    }
+    if (reuse_port && setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0) {
+        perror("Failed to set SO_REUSEPORT");
+        close(server_socket);
+        return -1;
     }
 
-    cleanup_database(server->conns.connections[0].conn);
+    if (bind(server_socket, (struct sockaddr *) &server->server_addr, sizeof(server->server_addr)) < 0) {
+        perror("Bind failed");
+        close(server_socket);
+        return -1;
+    }
+    if (listen(server_socket, server->config.listen_backlog) < 0) {
+        perror("Listen failed");
+        close(server_socket);
+        return -1;
+    }
+    return server_socket;
+}
 
-    server->server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server->server_socket == -1) {
-        perror("Socket creation failed");
+
+static void *event_loop_thread(void *loop) {
+    event_loop_run((EventLoop *)loop, &keep_running);
+    return NULL;
+}
+
+
+bool server_init(Server *server, int port) {
+    load_server_config(&server->config);
+    printf("Request tokenizer: %s\n", tokenizer_level_name(tokenizer_init()));
+
+    if (!headers_init() || !error_responses_init(DOCUMENT_ROOT"/errors") || !templates_init(DOCUMENT_ROOT) ||
+        !static_cache_init(DOCUMENT_ROOT"/static", server->config.static_cache_size) ||
+        !init_connection_pool(&server->conns) || !connection_registry_init()) {
         return false;
     }
 
+    cleanup_database(server->conns.connections[0].conn);
+
     server->server_addr.sin_family = AF_INET;
     server->server_addr.sin_addr.s_addr = INADDR_ANY;
     server->server_addr.sin_port = htons(port);
+    server->port = port;
 
-    if (bind(server->server_socket, (struct sockaddr *) &server->server_addr, sizeof(server->server_addr)) < 0) {
-        perror("Bind failed");
-        return false;
-    }
-    if (listen(server->server_socket, 10) < 0) {
-        perror("Listen failed");
-        return false;
+    // several listeners share the port through SO_REUSEPORT, letting the kernel spread connections among them
+    bool reuse_port = server->config.listeners > 1;
+    server->loop_count = 0;
+    for (int i = 0; i < server->config.listeners; ++i) {
+        int server_socket = open_listener(server, reuse_port);
+        if (server_socket == -1) {
+            return false;
+        }
+        if (!event_loop_init(&server->loops[i], server_socket, server->config.request_timeout,
+                             server->config.keep_alive_timeout, dispatch_connection)) {
+            close(server_socket);
+            return false;
+        }
+        server->loop_count++;
     }
 
-    server->port = port;
-
     for (int i = 0; i < THREAD_POOL_SIZE; ++i) {
-        if (pthread_create(&threads[i], NULL, worker_thread, &server->conns) != 0) {
+        if (pthread_create(&threads[i], NULL, worker_thread, server) != 0) {
             perror("Failed to create worker thread");
             return false;
         }
@@ -325,9 +409,7 @@ bool server_init(Server *server, int port) {
 
 
 void server_run(Server *server) {
-    printf("Server listening on port %d\n", server->port);
-
-    int server_socket = server->server_socket;
+    printf("Server listening on port %d with %d listener(s)\n", server->port, server->loop_count);
 
     struct sigaction sa;
     memset(&sa, 0, sizeof(sa));
@@ -336,53 +418,35 @@ void server_run(Server *server) {
     sa.sa_flags = SA_RESTART;
     sigaction(SIGINT, &sa, NULL);
     sigaction(SIGTERM, &sa, NULL);
-
-    while (keep_running) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        FD_SET(server_socket, &read_fds);
-
-        struct timeval timeout;
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
-
-        int ready = select(server_socket + 1, &read_fds, NULL, NULL, &timeout);
-
-        if (ready < 0) {
-            if (errno == EINTR) {
-                continue;
-            }
-            perror("Select failed");
+    // clients closing mid-response must not take the server down
+    signal(SIGPIPE, SIG_IGN);
+
+    // the first loop runs on the calling thread, every other listener gets its own
+    int loop_threads = 1;
+    for (; loop_threads < server->loop_count; ++loop_threads) {
+        if (pthread_create(&server->loop_threads[loop_threads], NULL, event_loop_thread,
+                           &server->loops[loop_threads]) != 0) {
+            perror("Failed to create event loop thread");
             break;
-        } else if (ready == 0) {
-            continue;
-        }
-
-        int client_socket = accept(server_socket, (struct sockaddr *) &client_addr, &client_len);
-        if (client_socket < 0) {
-            if (errno == EINTR) {
-                continue;
-            }
-            perror("Accept failed");
-            continue;
         }
+    }
+    event_loop_run(&server->loops[0], &keep_running);
 
-        printf("New connection accepted\n");
-        Task new_task = {client_socket, NULL};
-        enqueue_task(new_task);
+    for (int i = 1; i < loop_threads; ++i) {
+        pthread_join(server->loop_threads[i], NULL);
     }
 
     for (int i = 0; i < THREAD_POOL_SIZE; ++i) {
-        Task exit_task = {-1, NULL};
+        Task exit_task = {-1, NULL, NULL};
         enqueue_task(exit_task);
     }
 
     for (int i = 0; i < THREAD_POOL_SIZE; ++i) {
         pthread_join(threads[i], NULL);
     }
+    for (int i = 0; i < server->loop_count; ++i) {
+        event_loop_cleanup(&server->loops[i]);
+    }
 
     printf("Server shutting down...\n");
 }
\ No newline at end of file
@@ -2,10 +2,17 @@
 #define HTTP_SERVER_SERVER_H
 
 #include <arpa/inet.h>
+#include "event_loop.h"
 #include "util/task.h"
 
 #define CONN_POOL_SIZE 10
 #define THREAD_POOL_SIZE 10
+#define DEFAULT_REQUEST_TIMEOUT 10
+#define DEFAULT_KEEP_ALIVE_TIMEOUT 5
+#define DEFAULT_KEEP_ALIVE_MAX_REQUESTS 100
+#define DEFAULT_LISTENERS 1
+#define DEFAULT_LISTEN_BACKLOG SOMAXCONN
+#define MAX_LISTENERS 64
 
 
 typedef struct {
@@ -19,10 +26,22 @@ typedef struct {
 } ConnectionPool;
 
 typedef struct {
-    int server_socket;
+    int request_timeout;
+    int keep_alive_timeout;
+    int keep_alive_max_requests;
+    int listeners;
+    int listen_backlog;
+    int static_cache_size;
+} ServerConfig;
+
+typedef struct {
     struct sockaddr_in server_addr;
     int port;
     ConnectionPool conns;
+    ServerConfig config;
+    int loop_count;
+    EventLoop loops[MAX_LISTENERS];
+    pthread_t loop_threads[MAX_LISTENERS];
 } Server;
 
 bool server_init(Server *server, int port);
@@ -0,0 +1,416 @@
+#include "static_cache.h"
+#include "headers.h"
+#include "response.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | IN_DELETE_SELF)
+
+
+typedef struct {
+    int wd;
+    char *path;
+} Watch;
+
+static struct {
+    char root[PATH_MAX];
+    size_t budget;
+    size_t total_size;
+    size_t file_count;
+    StaticAsset *buckets[STATIC_CACHE_BUCKETS];
+    pthread_mutex_t mutex;
+    int inotify_fd;
+    Watch *watches;
+    int watch_count;
+    int watch_capacity;
+} cache = {.mutex = PTHREAD_MUTEX_INITIALIZER, .inotify_fd = -1};
+
+
+static unsigned hash_path(const char *path, size_t length) {
+    unsigned hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (unsigned char)path[i]) * 16777619u;
+    }
+    return hash & (STATIC_CACHE_BUCKETS - 1);
+}
+
+
+static void free_asset(StaticAsset *asset) {
+    free(asset->path);
+    for (int encoding = 0; encoding < ENCODING_COUNT; ++encoding) {
+        AssetVariant *variant = &asset->variants[encoding];
+        free(variant->data);
+        free(variant->headers[0]);
+        free(variant->headers[1]);
+    }
+    free(asset);
+}
+
+
+void static_cache_release(StaticAsset *asset) {
+    if (__atomic_sub_fetch(&asset->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free_asset(asset);
+    }
+}
+
+
+// the asset stays valid until it's released, even if the file changes in the meantime
+StaticAsset *static_cache_acquire(Slice path) {
+    if (cache.budget == 0) {
+        return NULL;
+    }
+    pthread_mutex_lock(&cache.mutex);
+    StaticAsset *asset = cache.buckets[hash_path(path.ptr, path.len)];
+    while (asset && (asset->path_length != path.len || memcmp(asset->path, path.ptr, path.len) != 0)) {
+        asset = asset->next;
+    }
+    if (asset) {
+        __atomic_add_fetch(&asset->refs, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&cache.mutex);
+    return asset;
+}
+
+
+// called with the mutex held
+static void remove_asset(const char *path) {
+    StaticAsset **link = &cache.buckets[hash_path(path, strlen(path))];
+    while (*link && strcmp((*link)->path, path) != 0) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        StaticAsset *asset = *link;
+        *link = asset->next;
+        cache.total_size -= asset->total_size;
+        cache.file_count--;
+        static_cache_release(asset);
+    }
+}
+
+
+// everything under a directory that was deleted or moved away
+static void remove_directory(const char *path) {
+    size_t length = strlen(path);
+    pthread_mutex_lock(&cache.mutex);
+    for (int i = 0; i < STATIC_CACHE_BUCKETS; ++i) {
+        StaticAsset **link = &cache.buckets[i];
+        while (*link) {
+            StaticAsset *asset = *link;
+            if (asset->path_length > length && strncmp(asset->path, path, length) == 0 && asset->path[length] == '/') {
+                *link = asset->next;
+                cache.total_size -= asset->total_size;
+                cache.file_count--;
+                static_cache_release(asset);
+            } else {
+                link = &asset->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&cache.mutex);
+}
+
+
+static bool build_headers(StaticAsset *asset, AssetVariant *variant, ContentEncoding encoding) {
+    char other[FILE_HEADERS_SIZE];
+    format_file_headers(other, variant->size, &variant->validators, encoding, asset->vary, true);
+    const char *content_type = get_content_type(asset->path);
+    for (int keep_alive = 0; keep_alive < 2; ++keep_alive) {
+        char block[HEADER_BLOCK_SIZE];
+        size_t length = format_header_block(block, 200, content_type, keep_alive, other);
+        if (length == 0) {
+            return false;
+        }
+        variant->headers[keep_alive] = malloc(length);
+        if (!variant->headers[keep_alive]) {
+            return false;
+        }
+        memcpy(variant->headers[keep_alive], block, length);
+        variant->header_lengths[keep_alive] = length;
+    }
+    asset->date_offset = strstr(variant->headers[0], "\r\n") + 2 - variant->headers[0];
+    return true;
+}
+
+
+// a sidecar is only used while it's smaller than and at least as new as the file it was compressed from
+static bool sidecar_usable(const struct stat *sidecar, const struct stat *original) {
+    if (sidecar->st_size >= original->st_size) {
+        return false;
+    }
+    return sidecar->st_mtim.tv_sec > original->st_mtim.tv_sec ||
+           (sidecar->st_mtim.tv_sec == original->st_mtim.tv_sec && sidecar->st_mtim.tv_nsec >= original->st_mtim.tv_nsec);
+}
+
+
+// original is NULL for the file itself; false if it's missing or unusable, which only matters for the file itself
+static bool read_variant(AssetVariant *variant, const char *file_path, struct stat *file_stat,
+                         const struct stat *original) {
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd == -1) {
+        return false;
+    }
+    if (fstat(fd, file_stat) != 0 || !S_ISREG(file_stat->st_mode) || file_stat->st_size > STATIC_CACHE_MAX_FILE_SIZE ||
+        (original && !sidecar_usable(file_stat, original))) {
+        close(fd);
+        return false;
+    }
+
+    variant->size = file_stat->st_size;
+    variant->data = malloc(variant->size > 0 ? variant->size : 1);
+    size_t bytes_read = 0;
+    while (variant->data && bytes_read < variant->size) {
+        ssize_t result = read(fd, variant->data + bytes_read, variant->size - bytes_read);
+        if (result <= 0) {
+            break;
+        }
+        bytes_read += result;
+    }
+    close(fd);
+    if (!variant->data || bytes_read != variant->size) {
+        free(variant->data);
+        variant->data = NULL;
+        return false;
+    }
+    return true;
+}
+
+
+static StaticAsset *read_asset(const char *path, const char *file_path) {
+    StaticAsset *asset = calloc(1, sizeof(StaticAsset));
+    if (!asset) {
+        return NULL;
+    }
+    asset->refs = 1;
+    asset->path = strdup(path);
+    asset->path_length = strlen(path);
+    struct stat file_stats[ENCODING_COUNT];
+    if (!asset->path || !read_variant(&asset->variants[ENCODING_IDENTITY], file_path, &file_stats[0], NULL)) {
+        free_asset(asset);
+        return NULL;
+    }
+    asset->available = ENCODING_BIT(ENCODING_IDENTITY);
+    asset->vary = is_compressible(get_content_type(path));
+
+    for (int encoding = ENCODING_IDENTITY + 1; asset->vary && encoding < ENCODING_COUNT; ++encoding) {
+        char sidecar_path[PATH_MAX];
+        if (snprintf(sidecar_path, sizeof(sidecar_path), "%s%s", file_path, encoding_suffix(encoding)) <
+            (int)sizeof(sidecar_path) &&
+            read_variant(&asset->variants[encoding], sidecar_path, &file_stats[encoding], &file_stats[0])) {
+            asset->available |= ENCODING_BIT(encoding);
+        }
+    }
+
+    for (int encoding = 0; encoding < ENCODING_COUNT; ++encoding) {
+        AssetVariant *variant = &asset->variants[encoding];
+        if (!(asset->available & ENCODING_BIT(encoding))) {
+            continue;
+        }
+        // the same validators the disk path would come up with, so a file moving in or out of the cache
+        // doesn't look changed to clients
+        validators_init(&variant->validators, variant->size, file_stats[encoding].st_mtim.tv_sec,
+                        file_stats[encoding].st_mtim.tv_nsec, encoding);
+        if (!build_headers(asset, variant, encoding)) {
+            free_asset(asset);
+            return NULL;
+        }
+        asset->total_size += variant->size;
+    }
+    return asset;
+}
+
+
+// path is relative to the root and starts with a slash, the way it appears in a request
+static void load_asset(const char *path) {
+    char file_path[PATH_MAX];
+    if (snprintf(file_path, sizeof(file_path), "%s%s", cache.root, path) >= (int)sizeof(file_path)) {
+        return;
+    }
+    StaticAsset *asset = read_asset(path, file_path);
+
+    pthread_mutex_lock(&cache.mutex);
+    remove_asset(path);
+    if (asset && cache.total_size + asset->total_size > cache.budget) {
+        fprintf(stderr, "Static cache budget exceeded, %s will be read from disk\n", path);
+        static_cache_release(asset);
+        asset = NULL;
+    }
+    if (asset) {
+        unsigned bucket = hash_path(path, asset->path_length);
+        asset->next = cache.buckets[bucket];
+        cache.buckets[bucket] = asset;
+        cache.total_size += asset->total_size;
+        cache.file_count++;
+    }
+    pthread_mutex_unlock(&cache.mutex);
+}
+
+
+static void add_watch(const char *path, const char *dir_path) {
+    if (cache.inotify_fd == -1) {
+        return;
+    }
+    int wd = inotify_add_watch(cache.inotify_fd, dir_path, WATCH_EVENTS);
+    if (wd == -1) {
+        perror("Failed to watch a static directory");
+        return;
+    }
+    if (cache.watch_count == cache.watch_capacity) {
+        int capacity = cache.watch_capacity ? cache.watch_capacity * 2 : 16;
+        Watch *watches = realloc(cache.watches, capacity * sizeof(Watch));
+        if (!watches) {
+            inotify_rm_watch(cache.inotify_fd, wd);
+            return;
+        }
+        cache.watches = watches;
+        cache.watch_capacity = capacity;
+    }
+    cache.watches[cache.watch_count++] = (Watch) {wd, strdup(path)};
+}
+
+
+// path is "" for the root itself
+static void load_directory(const char *path) {
+    char dir_path[PATH_MAX];
+    if (snprintf(dir_path, sizeof(dir_path), "%s%s", cache.root, path) >= (int)sizeof(dir_path)) {
+        return;
+    }
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        return;
+    }
+    add_watch(path, dir_path);
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char entry_path[PATH_MAX];
+        if (snprintf(entry_path, sizeof(entry_path), "%s/%s", path, entry->d_name) >= (int)sizeof(entry_path)) {
+            continue;
+        }
+        unsigned char type = entry->d_type;
+        struct stat entry_stat;
+        if (type == DT_UNKNOWN && fstatat(dirfd(dir), entry->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW) == 0) {
+            type = S_ISDIR(entry_stat.st_mode) ? DT_DIR : S_ISREG(entry_stat.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        // symlinks are left to the regular path, which checks where they lead;
+        // sidecars come along with the file they were compressed from
+        size_t base_length;
+        if (type == DT_DIR) {
+            load_directory(entry_path);
+        } else if (type == DT_REG && encoding_from_suffix(entry_path, &base_length) == ENCODING_IDENTITY) {
+            load_asset(entry_path);
+        }
+    }
+    closedir(dir);
+}
+
+
+static Watch *find_watch(int wd) {
+    for (int i = 0; i < cache.watch_count; ++i) {
+        if (cache.watches[i].wd == wd) {
+            return &cache.watches[i];
+        }
+    }
+    return NULL;
+}
+
+
+static void handle_event(const struct inotify_event *event) {
+    Watch *watch = find_watch(event->wd);
+    if (!watch) {
+        return;
+    }
+    if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+        free(watch->path);
+        *watch = cache.watches[--cache.watch_count];
+        return;
+    }
+    if (event->len == 0) {
+        return;
+    }
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", watch->path, event->name) >= (int)sizeof(path)) {
+        return;
+    }
+    size_t base_length;
+    if (event->mask & IN_ISDIR) {
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            load_directory(path);
+        } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            remove_directory(path);
+        }
+    } else if (encoding_from_suffix(path, &base_length) != ENCODING_IDENTITY) {
+        // a sidecar that changed or went away; the file it belongs to is read again along with what's left of them
+        if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)) {
+            path[base_length] = '\0';
+            load_asset(path);
+        }
+    } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        load_asset(path);
+    } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        pthread_mutex_lock(&cache.mutex);
+        remove_asset(path);
+        pthread_mutex_unlock(&cache.mutex);
+    }
+}
+
+
+// the watches are only touched from this thread once it runs
+static void *watch_static_files(void *arg) {
+    (void)arg;
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1) {
+        ssize_t length = read(cache.inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            perror("Failed to read static file changes");
+            return NULL;
+        }
+        for (char *p = buffer; p < buffer + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            handle_event(event);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+
+// reads every regular file under root into memory, up to budget bytes, and keeps them current from then on
+bool static_cache_init(const char *root, size_t budget) {
+    if (budget == 0) {
+        printf("Static cache disabled\n");
+        return true;
+    }
+    if (!realpath(root, cache.root)) {
+        perror("Invalid static root");
+        return false;
+    }
+    cache.budget = budget;
+    cache.inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (cache.inotify_fd == -1) {
+        perror("inotify is unavailable, static files won't be refreshed");
+    }
+
+    load_directory("");
+    printf("Static cache: %zu files, %zu bytes\n", cache.file_count, cache.total_size);
+
+    pthread_t watch_thread;
+    if (cache.inotify_fd != -1) {
+        if (pthread_create(&watch_thread, NULL, watch_static_files, NULL) != 0) {
+            perror("Failed to create the static file watcher thread");
+            return false;
+        }
+        pthread_detach(watch_thread);
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef HTTP_SERVER_STATIC_CACHE_H
+#define HTTP_SERVER_STATIC_CACHE_H
+
+#include "validators.h"
+#include "util/slice.h"
+#include <stddef.h>
+
+#define STATIC_CACHE_BUCKETS 256
+#define STATIC_CACHE_MAX_FILE_SIZE (1024 * 1024)
+#define DEFAULT_STATIC_CACHE_SIZE (32 * 1024 * 1024)
+
+
+// one representation of a file with its response prebuilt; headers is indexed by keep-alive
+typedef struct {
+    char *data;
+    size_t size;
+    char *headers[2];
+    size_t header_lengths[2];
+    Validators validators;
+} AssetVariant;
+
+// a file under the static root, along with whichever of its precompressed sidecars are usable; the Date line of
+// every prebuilt header block is stale and has to be overwritten at date_offset before sending
+typedef struct StaticAsset {
+    char *path;
+    size_t path_length;
+    AssetVariant variants[ENCODING_COUNT];
+    unsigned available;
+    bool vary;
+    size_t total_size;
+    size_t date_offset;
+    int refs;
+    struct StaticAsset *next;
+} StaticAsset;
+
+bool static_cache_init(const char *root, size_t budget);
+
+StaticAsset *static_cache_acquire(Slice path);
+
+void static_cache_release(StaticAsset *asset);
+
+
+#endif
@@ -0,0 +1,245 @@
+#include "templates.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+#define SLOT_OPENING "<!-- "
+#define SLOT_CLOSING " -->"
+
+
+typedef struct {
+    const char *directory;
+    const char *file_name;
+    const char *slots[MAX_TEMPLATE_SLOTS];
+} TemplateFile;
+
+static const TemplateFile FILES[TEMPLATE_COUNT] = {
+        [TEMPLATE_TODOS_PAGE]          = {"templates", "todos_page.html",          {"CSRF_TOKEN", "TODO_ITEMS"}},
+        [TEMPLATE_USER_PAGE]           = {"templates", "user_page.html",           {"CSRF_TOKEN", "USER_EMAIL"}},
+        [TEMPLATE_VERIFICATION_PAGE]   = {"templates", "verification_page.html",   {"RESULT_BODY"}},
+        [TEMPLATE_RESET_PASSWORD_PAGE] = {"",          "reset_password_page.html", {"V_TOKEN"}},
+        [TEMPLATE_EMAIL_VERIFICATION]  = {"mails",     "email_verification.html",  {"VER_FORM"}},
+        [TEMPLATE_PASSWORD_RESET]      = {"mails",     "password_reset.html",      {"RESET_LINK"}},
+};
+
+typedef struct {
+    int wd;
+    const char *directory;
+} Watch;
+
+static struct {
+    char root[PATH_MAX];
+    Template *templates[TEMPLATE_COUNT];
+    pthread_mutex_t mutex;
+    int inotify_fd;
+    Watch watches[TEMPLATE_COUNT];
+    int watch_count;
+} registry = {.mutex = PTHREAD_MUTEX_INITIALIZER, .inotify_fd = -1};
+
+
+static void free_template(Template *template) {
+    free(template->source);
+    free(template);
+}
+
+
+void template_release(Template *template) {
+    if (__atomic_sub_fetch(&template->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        free_template(template);
+    }
+}
+
+
+// the template stays valid until it's released, even if its file is reloaded in the meantime
+Template *template_acquire(TemplateId id) {
+    pthread_mutex_lock(&registry.mutex);
+    Template *template = registry.templates[id];
+    if (template) {
+        __atomic_add_fetch(&template->refs, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&registry.mutex);
+    return template;
+}
+
+
+static char *read_file(const char *file_path, size_t *size) {
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        perror("Error opening template file");
+        return NULL;
+    }
+    struct stat file_stat;
+    char *data = NULL;
+    size_t bytes_read = 0;
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode)) {
+        data = malloc(file_stat.st_size + 1);
+    }
+    while (data && bytes_read < (size_t)file_stat.st_size) {
+        ssize_t result = read(fd, data + bytes_read, file_stat.st_size - bytes_read);
+        if (result <= 0) {
+            break;
+        }
+        bytes_read += result;
+    }
+    close(fd);
+    if (!data || bytes_read != (size_t)file_stat.st_size) {
+        fprintf(stderr, "Failed to read template %s\n", file_path);
+        free(data);
+        return NULL;
+    }
+    data[bytes_read] = '\0';
+    *size = bytes_read;
+    return data;
+}
+
+
+// comments that aren't one of the template's slots are left in the literals
+static bool split_slots(Template *template, const TemplateFile *file) {
+    const char *literal = template->source;
+    const char *p = template->source;
+    while (template->slot_count < MAX_TEMPLATE_SLOTS && file->slots[template->slot_count] &&
+           (p = strstr(p, SLOT_OPENING))) {
+        const char *name = file->slots[template->slot_count];
+        size_t name_length = strlen(name);
+        const char *closing = p + sizeof(SLOT_OPENING) - 1 + name_length;
+        if (strncmp(p + sizeof(SLOT_OPENING) - 1, name, name_length) != 0 ||
+            strncmp(closing, SLOT_CLOSING, sizeof(SLOT_CLOSING) - 1) != 0) {
+            p += sizeof(SLOT_OPENING) - 1;
+            continue;
+        }
+        template->literals[template->slot_count++] = (Slice) {literal, p - literal};
+        literal = p = closing + sizeof(SLOT_CLOSING) - 1;
+    }
+    if (template->slot_count < MAX_TEMPLATE_SLOTS && file->slots[template->slot_count]) {
+        fprintf(stderr, "Template %s has no <!-- %s --> slot after the ones before it\n", file->file_name,
+                file->slots[template->slot_count]);
+        return false;
+    }
+    template->literals[template->slot_count] = (Slice) {literal, strlen(literal)};
+    return true;
+}
+
+
+// the one in use is only replaced once the new version has been read and split
+static bool load_template(TemplateId id) {
+    const TemplateFile *file = &FILES[id];
+    char file_path[PATH_MAX];
+    if (snprintf(file_path, sizeof(file_path), "%s/%s%s%s", registry.root, file->directory,
+                 *file->directory ? "/" : "", file->file_name) >= (int)sizeof(file_path)) {
+        return false;
+    }
+
+    Template *template = calloc(1, sizeof(Template));
+    if (!template) {
+        perror("Failed to allocate memory for a template");
+        return false;
+    }
+    size_t size;
+    template->source = read_file(file_path, &size);
+    template->refs = 1;
+    if (!template->source || !split_slots(template, file)) {
+        free_template(template);
+        return false;
+    }
+
+    pthread_mutex_lock(&registry.mutex);
+    Template *previous = registry.templates[id];
+    registry.templates[id] = template;
+    pthread_mutex_unlock(&registry.mutex);
+    if (previous) {
+        template_release(previous);
+    }
+    return true;
+}
+
+
+static void add_watch(const char *directory) {
+    for (int i = 0; i < registry.watch_count; ++i) {
+        if (strcmp(registry.watches[i].directory, directory) == 0) {
+            return;
+        }
+    }
+    char dir_path[PATH_MAX];
+    if (snprintf(dir_path, sizeof(dir_path), "%s/%s", registry.root, directory) >= (int)sizeof(dir_path)) {
+        return;
+    }
+    int wd = inotify_add_watch(registry.inotify_fd, dir_path, WATCH_EVENTS);
+    if (wd == -1) {
+        perror("Failed to watch a template directory");
+        return;
+    }
+    registry.watches[registry.watch_count++] = (Watch) {wd, directory};
+}
+
+
+static void handle_event(const struct inotify_event *event) {
+    if (event->len == 0) {
+        return;
+    }
+    for (int i = 0; i < registry.watch_count; ++i) {
+        if (registry.watches[i].wd != event->wd) {
+            continue;
+        }
+        for (int id = 0; id < TEMPLATE_COUNT; ++id) {
+            if (strcmp(FILES[id].directory, registry.watches[i].directory) == 0 &&
+                strcmp(FILES[id].file_name, event->name) == 0 && !load_template(id)) {
+                fprintf(stderr, "Keeping the previous version of %s\n", FILES[id].file_name);
+            }
+        }
+    }
+}
+
+
+static void *watch_templates(void *arg) {
+    (void)arg;
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (1) {
+        ssize_t length = read(registry.inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            perror("Failed to read template changes");
+            return NULL;
+        }
+        for (char *p = buffer; p < buffer + length;) {
+            const struct inotify_event *event = (const struct inotify_event *)p;
+            handle_event(event);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+
+// every template has to load at startup; an edit that breaks one later on leaves the previous version in use
+bool templates_init(const char *root) {
+    if (!realpath(root, registry.root)) {
+        perror("Invalid template root");
+        return false;
+    }
+    for (int id = 0; id < TEMPLATE_COUNT; ++id) {
+        if (!load_template(id)) {
+            return false;
+        }
+    }
+
+    registry.inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (registry.inotify_fd == -1) {
+        perror("inotify is unavailable, templates won't be reloaded");
+        return true;
+    }
+    for (int id = 0; id < TEMPLATE_COUNT; ++id) {
+        add_watch(FILES[id].directory);
+    }
+    pthread_t watch_thread;
+    if (pthread_create(&watch_thread, NULL, watch_templates, NULL) != 0) {
+        perror("Failed to create the template watcher thread");
+        return false;
+    }
+    pthread_detach(watch_thread);
+    return true;
+}
\ No newline at end of file
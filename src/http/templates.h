@@ -0,0 +1,36 @@
+#ifndef HTTP_SERVER_TEMPLATES_H
+#define HTTP_SERVER_TEMPLATES_H
+
+#include "util/slice.h"
+#include <stddef.h>
+
+#define MAX_TEMPLATE_SLOTS 4
+
+
+typedef enum {
+    TEMPLATE_TODOS_PAGE,
+    TEMPLATE_USER_PAGE,
+    TEMPLATE_VERIFICATION_PAGE,
+    TEMPLATE_RESET_PASSWORD_PAGE,
+    TEMPLATE_EMAIL_VERIFICATION,
+    TEMPLATE_PASSWORD_RESET,
+    TEMPLATE_COUNT
+} TemplateId;
+
+// a template file split at its <!-- NAME --> slots, which come in the order they're declared for it in templates.c;
+// literals[i] is the text in front of slot i, and literals[slot_count] the text after the last one
+typedef struct {
+    char *source;
+    Slice literals[MAX_TEMPLATE_SLOTS + 1];
+    int slot_count;
+    int refs;
+} Template;
+
+bool templates_init(const char *root);
+
+Template *template_acquire(TemplateId id);
+
+void template_release(Template *template);
+
+
+#endif
@@ -0,0 +1,213 @@
+#include "tokenizer.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TOKENIZER_X86
+#endif
+
+
+static const char *find_scalar(const char *start, const char *end, char first, char second) {
+    if (first == second) {
+        return memchr(start, first, end - start);
+    }
+    for (; start < end; ++start) {
+        if (*start == first || *start == second) {
+            return start;
+        }
+    }
+    return NULL;
+}
+
+
+// one bit per byte of word that equals c, in memory order
+static unsigned word_mask(uint64_t word, char c) {
+    const uint64_t low_bits = 0x7f7f7f7f7f7f7f7full;
+    uint64_t x = word ^ (0x0101010101010101ull * (unsigned char)c);
+    uint64_t zero_bytes = ~(((x & low_bits) + low_bits) | x | low_bits);
+    return (unsigned)(((zero_bytes >> 7) * 0x0102040810204080ull) >> 56);
+}
+
+
+// eight bytes at a time within a general purpose register, for CPUs without the vector paths
+static void classify_scalar(const char *start, size_t length, char first, char second, uint64_t *firsts,
+                            uint64_t *seconds) {
+    uint64_t first_mask = 0;
+    uint64_t second_mask = 0;
+    size_t i = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, start + i, sizeof(word));
+        first_mask |= (uint64_t)word_mask(word, first) << i;
+        second_mask |= (uint64_t)word_mask(word, second) << i;
+    }
+#endif
+    for (; i < length; ++i) {
+        first_mask |= (uint64_t)(start[i] == first) << i;
+        second_mask |= (uint64_t)(start[i] == second) << i;
+    }
+    *firsts = first_mask;
+    *seconds = second_mask;
+}
+
+
+#ifdef TOKENIZER_X86
+// the tail shorter than a vector is left to the scalar loop, so nothing past end is ever read
+__attribute__((target("sse4.2")))
+static const char *find_sse42(const char *start, const char *end, char first, char second) {
+    const __m128i set = _mm_setr_epi8(first, second, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    while (end - start >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)start);
+        int index = _mm_cmpestri(set, 2, chunk, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (index != 16) {
+            return start + index;
+        }
+        start += 16;
+    }
+    return find_scalar(start, end, first, second);
+}
+
+
+__attribute__((target("avx2")))
+static const char *find_avx2(const char *start, const char *end, char first, char second) {
+    const __m256i first_set = _mm256_set1_epi8(first);
+    const __m256i second_set = _mm256_set1_epi8(second);
+    while (end - start >= 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)start);
+        __m256i matches = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, first_set), _mm256_cmpeq_epi8(chunk, second_set));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(matches);
+        if (mask) {
+            return start + __builtin_ctz(mask);
+        }
+        start += 32;
+    }
+    return find_sse42(start, end, first, second);
+}
+
+
+__attribute__((target("sse4.2")))
+static void classify_sse42(const char *start, size_t length, char first, char second, uint64_t *firsts,
+                           uint64_t *seconds) {
+    const __m128i first_set = _mm_set1_epi8(first);
+    const __m128i second_set = _mm_set1_epi8(second);
+    uint64_t first_mask = 0;
+    uint64_t second_mask = 0;
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(start + i));
+        first_mask |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, first_set)) << i;
+        second_mask |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, second_set)) << i;
+    }
+    if (i < length) {
+        uint64_t first_tail, second_tail;
+        classify_scalar(start + i, length - i, first, second, &first_tail, &second_tail);
+        first_mask |= first_tail << i;
+        second_mask |= second_tail << i;
+    }
+    *firsts = first_mask;
+    *seconds = second_mask;
+}
+
+
+__attribute__((target("avx2")))
+static void classify_avx2(const char *start, size_t length, char first, char second, uint64_t *firsts,
+                          uint64_t *seconds) {
+    if (length < 64) {
+        classify_sse42(start, length, first, second, firsts, seconds);
+        return;
+    }
+    const __m256i first_set = _mm256_set1_epi8(first);
+    const __m256i second_set = _mm256_set1_epi8(second);
+    __m256i low = _mm256_loadu_si256((const __m256i *)start);
+    __m256i high = _mm256_loadu_si256((const __m256i *)(start + 32));
+    *firsts = (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, first_set)) |
+              (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, first_set)) << 32;
+    *seconds = (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, second_set)) |
+               (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, second_set)) << 32;
+}
+#endif
+
+
+static TokenizerLevel current_level = TOKENIZER_SCALAR;
+static const char *(*find_implementation)(const char *, const char *, char, char) = find_scalar;
+static void (*classify_implementation)(const char *, size_t, char, char, uint64_t *, uint64_t *) = classify_scalar;
+
+
+static bool level_supported(TokenizerLevel level) {
+#ifdef TOKENIZER_X86
+    __builtin_cpu_init();
+    switch (level) {
+        case TOKENIZER_AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2");
+        case TOKENIZER_SSE42:
+            return __builtin_cpu_supports("sse4.2");
+        default:
+            return true;
+    }
+#else
+    return level == TOKENIZER_SCALAR;
+#endif
+}
+
+
+// has to run before worker threads start; the vector paths don't beat the scalar one on requests of a few hundred
+// bytes (see bench/parser_bench.c), so they're left to tokenizer_use
+TokenizerLevel tokenizer_init() {
+    tokenizer_use(TOKENIZER_SCALAR);
+    return TOKENIZER_SCALAR;
+}
+
+
+bool tokenizer_use(TokenizerLevel level) {
+    if (!level_supported(level)) {
+        return false;
+    }
+    switch (level) {
+#ifdef TOKENIZER_X86
+        case TOKENIZER_AVX2:
+            find_implementation = find_avx2;
+            classify_implementation = classify_avx2;
+            break;
+        case TOKENIZER_SSE42:
+            find_implementation = find_sse42;
+            classify_implementation = classify_sse42;
+            break;
+#endif
+        default:
+            find_implementation = find_scalar;
+            classify_implementation = classify_scalar;
+    }
+    current_level = level;
+    return true;
+}
+
+
+TokenizerLevel tokenizer_level() {
+    return current_level;
+}
+
+
+const char *tokenizer_level_name(TokenizerLevel level) {
+    switch (level) {
+        case TOKENIZER_AVX2:
+            return "avx2";
+        case TOKENIZER_SSE42:
+            return "sse4.2";
+        default:
+            return "scalar";
+    }
+}
+
+
+// first occurrence of either byte in [start, end), NULL if there's none
+const char *tokenizer_find(const char *start, const char *end, char first, char second) {
+    return find_implementation(start, end, first, second);
+}
+
+
+// bit i of firsts and seconds tells whether start[i] is first or second; length is at most 64
+void tokenizer_classify(const char *start, size_t length, char first, char second, uint64_t *firsts,
+                        uint64_t *seconds) {
+    classify_implementation(start, length, first, second, firsts, seconds);
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef HTTP_SERVER_TOKENIZER_H
+#define HTTP_SERVER_TOKENIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    TOKENIZER_SCALAR,
+    TOKENIZER_SSE42,
+    TOKENIZER_AVX2,
+} TokenizerLevel;
+
+TokenizerLevel tokenizer_init();
+
+TokenizerLevel tokenizer_level();
+
+bool tokenizer_use(TokenizerLevel level);
+
+const char *tokenizer_level_name(TokenizerLevel level);
+
+const char *tokenizer_find(const char *start, const char *end, char first, char second);
+
+void tokenizer_classify(const char *start, size_t length, char first, char second, uint64_t *firsts,
+                        uint64_t *seconds);
+
+
+#endif
@@ -0,0 +1,32 @@
+#define _GNU_SOURCE
+
+#include "slice.h"
+#include <string.h>
+
+
+Slice slice_skip(Slice slice, size_t count) {
+    if (count > slice.len) {
+        count = slice.len;
+    }
+    return (Slice) {slice.ptr + count, slice.len - count};
+}
+
+
+bool slice_equals(Slice slice, const char *str) {
+    size_t length = strlen(str);
+    return slice.len == length && memcmp(slice.ptr, str, length) == 0;
+}
+
+
+bool slice_starts_with(Slice slice, const char *prefix) {
+    size_t length = strlen(prefix);
+    return slice.len >= length && memcmp(slice.ptr, prefix, length) == 0;
+}
+
+
+const char *slice_find(Slice slice, const char *needle) {
+    if (slice.len == 0) {
+        return NULL;
+    }
+    return memmem(slice.ptr, slice.len, needle, strlen(needle));
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef HTTP_SERVER_SLICE_H
+#define HTTP_SERVER_SLICE_H
+
+#include <stddef.h>
+
+
+// a view into memory owned by someone else, usually a connection's receive buffer; not NUL-terminated
+typedef struct {
+    const char *ptr;
+    size_t len;
+} Slice;
+
+Slice slice_skip(Slice slice, size_t count);
+
+bool slice_equals(Slice slice, const char *str);
+
+bool slice_starts_with(Slice slice, const char *prefix);
+
+const char *slice_find(Slice slice, const char *needle);
+
+
+#endif
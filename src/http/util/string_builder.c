@@ -0,0 +1,146 @@
+#include "string_builder.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+// the buffer is kept between uses, so a thread's requests settle at the capacity they need
+static _Thread_local StringBuilder thread_builder;
+
+
+// this thread's builder, emptied; whatever was built with it before is gone, so it can't be held across calls that
+// might build something of their own
+StringBuilder *string_builder_get() {
+    StringBuilder *builder = &thread_builder;
+    if (builder->capacity > STRING_BUILDER_MAX_RETAINED) {
+        free(builder->data);
+        builder->data = NULL;
+        builder->capacity = 0;
+    }
+    builder->length = 0;
+    builder->failed = false;
+    if (builder->data) {
+        builder->data[0] = '\0';
+    }
+    return builder;
+}
+
+
+static bool reserve(StringBuilder *builder, size_t additional) {
+    if (builder->failed) {
+        return false;
+    }
+    size_t required = builder->length + additional + 1;
+    if (required <= builder->capacity) {
+        return true;
+    }
+    size_t capacity = builder->capacity ? builder->capacity : STRING_BUILDER_INITIAL_CAPACITY;
+    while (capacity < required) {
+        capacity *= 2;
+    }
+    char *data = realloc(builder->data, capacity);
+    if (!data) {
+        perror("Failed to grow a string builder");
+        builder->failed = true;
+        return false;
+    }
+    builder->data = data;
+    builder->capacity = capacity;
+    return true;
+}
+
+
+void builder_append(StringBuilder *builder, const char *data, size_t length) {
+    if (!reserve(builder, length)) {
+        return;
+    }
+    memcpy(builder->data + builder->length, data, length);
+    builder->length += length;
+    builder->data[builder->length] = '\0';
+}
+
+
+static bool needs_escaping(char c) {
+    return c == '<' || c == '>' || c == '&' || c == '"' || c == '\'';
+}
+
+
+// the first byte in [start, end) that has to be escaped, or end
+static const char *find_special(const char *start, const char *end) {
+#ifdef __SSE2__
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i quot = _mm_set1_epi8('"');
+    const __m128i apos = _mm_set1_epi8('\'');
+    while (end - start >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)start);
+        __m128i matches = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, lt), _mm_cmpeq_epi8(chunk, gt)),
+                                       _mm_or_si128(_mm_cmpeq_epi8(chunk, amp), _mm_cmpeq_epi8(chunk, quot)));
+        matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chunk, apos));
+        unsigned mask = (unsigned)_mm_movemask_epi8(matches);
+        if (mask) {
+            return start + __builtin_ctz(mask);
+        }
+        start += 16;
+    }
+#endif
+    while (start < end && !needs_escaping(*start)) {
+        start++;
+    }
+    return start;
+}
+
+
+// safe inside element content and quoted attribute values alike
+void builder_append_escaped(StringBuilder *builder, const char *data, size_t length) {
+    const char *end = data + length;
+    while (data < end) {
+        const char *special = find_special(data, end);
+        builder_append(builder, data, special - data);
+        if (special == end) {
+            return;
+        }
+        switch (*special) {
+            case '<':
+                builder_append_literal(builder, "&lt;");
+                break;
+            case '>':
+                builder_append_literal(builder, "&gt;");
+                break;
+            case '&':
+                builder_append_literal(builder, "&amp;");
+                break;
+            case '"':
+                builder_append_literal(builder, "&quot;");
+                break;
+            default:
+                builder_append_literal(builder, "&#39;");
+        }
+        data = special + 1;
+    }
+}
+
+
+void builder_append_escaped_str(StringBuilder *builder, const char *str) {
+    builder_append_escaped(builder, str, strlen(str));
+}
+
+
+void builder_append_int(StringBuilder *builder, long long value) {
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    unsigned long long magnitude = value < 0 ? 0ull - (unsigned long long)value : (unsigned long long)value;
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        *--p = '-';
+    }
+    builder_append(builder, p, digits + sizeof(digits) - p);
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef HTTP_SERVER_STRING_BUILDER_H
+#define HTTP_SERVER_STRING_BUILDER_H
+
+#include <stddef.h>
+
+#define STRING_BUILDER_INITIAL_CAPACITY 4096
+#define STRING_BUILDER_MAX_RETAINED (256 * 1024)
+
+#define builder_append_literal(builder, literal) builder_append(builder, literal, sizeof(literal) - 1)
+
+
+// text that grows by doubling and is always NUL-terminated; once an allocation fails, failed is set and every
+// further append is dropped, so callers only have to check at the end
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} StringBuilder;
+
+StringBuilder *string_builder_get();
+
+void builder_append(StringBuilder *builder, const char *data, size_t length);
+
+void builder_append_escaped(StringBuilder *builder, const char *data, size_t length);
+
+void builder_append_escaped_str(StringBuilder *builder, const char *str);
+
+void builder_append_int(StringBuilder *builder, long long value);
+
+
+#endif
@@ -4,9 +4,12 @@
 #include <libpq-fe.h>
 
 
+typedef struct Connection Connection;
+
 typedef struct {
     int client_socket;
     PGconn *db_conn;
+    Connection *conn;
 } Task;
 
 
@@ -0,0 +1,218 @@
+#include "uring.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+
+// thin wrapper over the raw io_uring syscalls, so the backend doesn't depend on liburing being installed
+static int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+
+static int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+
+static int io_uring_register(int ring_fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+
+bool ring_init(Ring *ring, unsigned entries) {
+    memset(ring, 0, sizeof(Ring));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring->ring_fd = io_uring_setup(entries, &params);
+    if (ring->ring_fd < 0) {
+        return false;
+    }
+    ring->entries = params.sq_entries;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        perror("Failed to map the submission queue");
+        close(ring->ring_fd);
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->ring_fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            perror("Failed to map the completion queue");
+            munmap(ring->sq_ring, ring->sq_ring_size);
+            close(ring->ring_fd);
+            return false;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        perror("Failed to map the submission queue entries");
+        if (ring->cq_ring != ring->sq_ring) {
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        }
+        munmap(ring->sq_ring, ring->sq_ring_size);
+        close(ring->ring_fd);
+        return false;
+    }
+
+    char *sq = ring->sq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->sqe_tail = ring->submitted_tail = *ring->sq_tail;
+
+    char *cq = ring->cq_ring;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return true;
+}
+
+
+// a full submission queue is flushed to the kernel first, so callers only see NULL if that fails too
+struct io_uring_sqe *ring_get_sqe(Ring *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail - head >= ring->entries) {
+        if (ring_submit_and_wait(ring, 0) < 0) {
+            return NULL;
+        }
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sqe_tail - head >= ring->entries) {
+            return NULL;
+        }
+    }
+
+    unsigned index = ring->sqe_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sq_array[index] = index;
+    ring->sqe_tail++;
+    return sqe;
+}
+
+
+int ring_submit_and_wait(Ring *ring, unsigned wait_nr) {
+    unsigned to_submit = ring->sqe_tail - ring->submitted_tail;
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+    ring->submitted_tail = ring->sqe_tail;
+
+    if (to_submit == 0 && wait_nr == 0) {
+        return 0;
+    }
+    while (1) {
+        int submitted = io_uring_enter(ring->ring_fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+        if (submitted >= 0) {
+            return submitted;
+        } else if (errno == EINTR && to_submit > 0) {
+            continue;
+        }
+        return -errno;
+    }
+}
+
+
+struct io_uring_cqe *ring_peek_cqe(Ring *ring) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+
+void ring_cqe_seen(Ring *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+
+// count has to be a power of two; every buffer starts out handed to the kernel
+bool buffer_ring_init(BufferRing *buffers, Ring *ring, unsigned count, unsigned buffer_size, unsigned short group) {
+    buffers->count = count;
+    buffers->buffer_size = buffer_size;
+    buffers->group = group;
+
+    size_t ring_size = count * sizeof(struct io_uring_buf);
+    buffers->ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers->ring == MAP_FAILED) {
+        perror("Failed to map the buffer ring");
+        return false;
+    }
+    buffers->buffers = malloc((size_t)count * buffer_size);
+    if (!buffers->buffers) {
+        perror("Failed to allocate memory for the receive buffers");
+        munmap(buffers->ring, ring_size);
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)buffers->ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (io_uring_register(ring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        free(buffers->buffers);
+        munmap(buffers->ring, ring_size);
+        return false;
+    }
+
+    buffers->ring->tail = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        buffer_ring_recycle(buffers, i);
+    }
+    return true;
+}
+
+
+char *buffer_ring_get(BufferRing *buffers, unsigned short id) {
+    return buffers->buffers + (size_t)id * buffers->buffer_size;
+}
+
+
+void buffer_ring_recycle(BufferRing *buffers, unsigned short id) {
+    unsigned short tail = buffers->ring->tail;
+    struct io_uring_buf *buf = &buffers->ring->bufs[tail & (buffers->count - 1)];
+    buf->addr = (unsigned long)buffer_ring_get(buffers, id);
+    buf->len = buffers->buffer_size;
+    buf->bid = id;
+    __atomic_store_n(&buffers->ring->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+
+void buffer_ring_free(BufferRing *buffers) {
+    munmap(buffers->ring, buffers->count * sizeof(struct io_uring_buf));
+    free(buffers->buffers);
+}
+
+
+void ring_exit(Ring *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->ring_fd);
+}
\ No newline at end of file
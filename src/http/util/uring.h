@@ -0,0 +1,58 @@
+#ifndef HTTP_SERVER_URING_H
+#define HTTP_SERVER_URING_H
+
+#include <linux/io_uring.h>
+#include <stddef.h>
+
+
+typedef struct {
+    int ring_fd;
+    unsigned entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sqe_tail;
+    unsigned submitted_tail;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} Ring;
+
+typedef struct {
+    struct io_uring_buf_ring *ring;
+    char *buffers;
+    unsigned count;
+    unsigned buffer_size;
+    unsigned short group;
+} BufferRing;
+
+bool ring_init(Ring *ring, unsigned entries);
+
+struct io_uring_sqe *ring_get_sqe(Ring *ring);
+
+int ring_submit_and_wait(Ring *ring, unsigned wait_nr);
+
+struct io_uring_cqe *ring_peek_cqe(Ring *ring);
+
+void ring_cqe_seen(Ring *ring);
+
+bool buffer_ring_init(BufferRing *buffers, Ring *ring, unsigned count, unsigned buffer_size, unsigned short group);
+
+char *buffer_ring_get(BufferRing *buffers, unsigned short id);
+
+void buffer_ring_recycle(BufferRing *buffers, unsigned short id);
+
+void buffer_ring_free(BufferRing *buffers);
+
+void ring_exit(Ring *ring);
+
+
+#endif
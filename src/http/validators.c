@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+
+#include "validators.h"
+#include <stdio.h>
+#include <string.h>
+
+#define HTTP_DATE_FORMAT "%a, %d %b %Y %H:%M:%S GMT"
+
+
+void validators_init(Validators *validators, off_t size, time_t mtime_seconds, long mtime_nanoseconds,
+                     ContentEncoding encoding) {
+    unsigned long long mtime = (unsigned long long)mtime_seconds * 1000000000ull + mtime_nanoseconds;
+    if (encoding == ENCODING_IDENTITY) {
+        validators->etag_length = snprintf(validators->etag, sizeof(validators->etag), "\"%llx-%llx\"",
+                                           (unsigned long long)size, mtime);
+    } else {
+        validators->etag_length = snprintf(validators->etag, sizeof(validators->etag), "\"%llx-%llx-%s\"",
+                                           (unsigned long long)size, mtime, encoding_name(encoding));
+    }
+    validators->last_modified = mtime_seconds;
+}
+
+
+// buffer has to hold VALIDATOR_HEADERS_SIZE bytes
+size_t format_validators(char *buffer, const Validators *validators) {
+    struct tm tm;
+    gmtime_r(&validators->last_modified, &tm);
+    char date[64];
+    strftime(date, sizeof(date), HTTP_DATE_FORMAT, &tm);
+    return snprintf(buffer, VALIDATOR_HEADERS_SIZE, "ETag: %s\r\nLast-Modified: %s\r\n", validators->etag, date);
+}
+
+
+// weak comparison, as If-None-Match asks for; every tag we hand out is strong, so W/ only has to be skipped
+static bool etag_matches(Slice header, const Validators *validators) {
+    const char *p = header.ptr;
+    const char *end = header.ptr + header.len;
+    while (p < end) {
+        if (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+            continue;
+        }
+        if (*p == '*') {
+            return true;
+        }
+        if (end - p > 2 && p[0] == 'W' && p[1] == '/') {
+            p += 2;
+        }
+        if (*p != '"') {
+            return false;
+        }
+        const char *close = memchr(p + 1, '"', end - p - 1);
+        if (!close) {
+            return false;
+        }
+        size_t length = close + 1 - p;
+        if (length == validators->etag_length && memcmp(p, validators->etag, length) == 0) {
+            return true;
+        }
+        p = close + 1;
+    }
+    return false;
+}
+
+
+// IMF-fixdate, plus the two obsolete formats recipients still have to accept
+bool parse_http_date(Slice header, time_t *result) {
+    static const char *const formats[] = {HTTP_DATE_FORMAT, "%A, %d-%b-%y %H:%M:%S GMT", "%a %b %e %H:%M:%S %Y"};
+    char date[64];
+    if (header.len >= sizeof(date)) {
+        return false;
+    }
+    memcpy(date, header.ptr, header.len);
+    date[header.len] = '\0';
+
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        const char *end = strptime(date, formats[i], &tm);
+        if (end && *end == '\0') {
+            *result = timegm(&tm);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// If-Modified-Since only counts when there's no If-None-Match, and is ignored when it isn't a valid date
+bool request_not_modified(const HttpRequest *request, const Validators *validators) {
+    if (!request) {
+        return false;
+    }
+    Slice if_none_match = request_header(request, HDR_IF_NONE_MATCH);
+    if (if_none_match.ptr) {
+        return etag_matches(if_none_match, validators);
+    }
+    Slice if_modified_since = request_header(request, HDR_IF_MODIFIED_SINCE);
+    time_t since;
+    if (if_modified_since.ptr && parse_http_date(if_modified_since, &since)) {
+        return validators->last_modified <= since;
+    }
+    return false;
+}
\ No newline at end of file
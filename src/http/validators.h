@@ -0,0 +1,32 @@
+#ifndef HTTP_SERVER_VALIDATORS_H
+#define HTTP_SERVER_VALIDATORS_H
+
+#include "request.h"
+#include "encoding.h"
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+
+#define ETAG_SIZE 48
+#define VALIDATOR_HEADERS_SIZE 128
+
+
+// what a client can revalidate a file against; the ETag is quoted, changes whenever the size or mtime does
+// and names the content coding, as every encoded variant is a representation of its own
+typedef struct {
+    char etag[ETAG_SIZE];
+    size_t etag_length;
+    time_t last_modified;
+} Validators;
+
+void validators_init(Validators *validators, off_t size, time_t mtime_seconds, long mtime_nanoseconds,
+                     ContentEncoding encoding);
+
+size_t format_validators(char *buffer, const Validators *validators);
+
+bool parse_http_date(Slice header, time_t *result);
+
+bool request_not_modified(const HttpRequest *request, const Validators *validators);
+
+
+#endif
@@ -1,6 +1,5 @@
 #include "http/server.h"
 #include <stdlib.h>
-#include <unistd.h>
 
 #define PORT 8080
 
@@ -13,7 +12,6 @@ int main() {
 
     server_run(&server);
 
-    close(server.server_socket);
     cleanup_connection_pool(&server.conns);
 
     return 0;
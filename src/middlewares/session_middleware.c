@@ -3,37 +3,56 @@
 #include <string.h>
 
 
-static bool extract_session_token(const char *cookie_header, char *session_token, size_t max_length) {
-    const char *token_start = strstr(cookie_header, "session=");
+// cookies are "name=value" pairs separated by "; ", only a cookie named exactly session counts
+static bool extract_session_token(Slice cookie_header, char *session_token, size_t max_length) {
+    const char *cookie = cookie_header.ptr;
+    const char *cookie_end = cookie_header.ptr + cookie_header.len;
+    const char *token_start = NULL;
+    const char *token_end = NULL;
+
+    while (cookie < cookie_end) {
+        while (cookie < cookie_end && (*cookie == ' ' || *cookie == ';')) cookie++;
+        const char *pair_end = memchr(cookie, ';', cookie_end - cookie);
+        if (!pair_end) pair_end = cookie_end;
+
+        if (pair_end - cookie >= 8 && memcmp(cookie, "session=", 8) == 0) {
+            token_start = cookie + 8;
+            token_end = pair_end;
+            break;
+        }
+        cookie = pair_end;
+    }
     if (!token_start) {
         fprintf(stderr, "No session token found in cookies\n");
         return false;
     }
-
-    token_start += 8;
-    const char *token_end = strpbrk(token_start, ";\r\n");
-    size_t token_length = token_end ? (size_t)(token_end - token_start) : strlen(token_start);
+    size_t token_length = token_end - token_start;
 
     if (token_length > max_length) {
         fprintf(stderr, "Invalid session token length\n");
         return false;
     }
 
-    strncpy(session_token, token_start, token_length);
+    memcpy(session_token, token_start, token_length);
     session_token[token_length] = '\0';
     return true;
 }
 
 
-QueryResult check_session(const char *headers, PGconn *conn, int *user_id, char *csrf_token) {
-    const char *cookie_header = strstr(headers, "\r\nCookie: ");
-    if (!cookie_header) {
+// for handlers that batch the session check with their own queries
+bool read_session_token(HttpRequest *req, char *session_token) {
+    Slice cookie_header = request_header(req, HDR_COOKIE);
+    if (!cookie_header.ptr) {
         fprintf(stderr, "No Cookie Header found\n");
-        return QRESULT_NONE_AFFECTED;
+        return false;
     }
+    return extract_session_token(cookie_header, session_token, MAX_TOKEN_LENGTH);
+}
+
 
+QueryResult check_session(HttpRequest *req, PGconn *conn, int *user_id, char *csrf_token) {
     char session_token[MAX_TOKEN_LENGTH + 1];
-    if (!extract_session_token(cookie_header, session_token, MAX_TOKEN_LENGTH)) {
+    if (!read_session_token(req, session_token)) {
         return QRESULT_NONE_AFFECTED;
     }
 
@@ -41,9 +60,9 @@ QueryResult check_session(const char *headers, PGconn *conn, int *user_id, char
 }
 
 
-QueryResult check_and_retrieve_session(const char *headers, PGconn *conn, int *user_id, char *csrf_token, char *session_token, size_t max_length) {
-    const char *cookie_header = strstr(headers, "\r\nCookie: ");
-    if (!cookie_header) {
+QueryResult check_and_retrieve_session(HttpRequest *req, PGconn *conn, int *user_id, char *csrf_token, char *session_token, size_t max_length) {
+    Slice cookie_header = request_header(req, HDR_COOKIE);
+    if (!cookie_header.ptr) {
         fprintf(stderr, "No Cookie Header found\n");
         return QRESULT_NONE_AFFECTED;
     }
@@ -57,22 +76,15 @@ QueryResult check_and_retrieve_session(const char *headers, PGconn *conn, int *u
 
 
 bool check_csrf_token(HttpRequest *req, const char *expected_csrf_token) {
-    char *token_start = strstr(req->headers, "\r\nX-CSRF-Token: ");
-    if (!token_start) {
+    Slice provided_csrf_token = request_header(req, HDR_X_CSRF_TOKEN);
+    if (!provided_csrf_token.ptr) {
         fprintf(stderr, "No CSRF token header found\n");
         return false;
     }
-    token_start += 16;
-    const char *token_end = strstr(token_start, "\r\n");
-    size_t token_length = token_end ? (size_t)(token_end - token_start) : strlen(token_start);
 
-    if (token_length > MAX_TOKEN_LENGTH) {
+    if (provided_csrf_token.len > MAX_TOKEN_LENGTH) {
         fprintf(stderr, "Invalid CSRF token length");
         return false;
     }
-    char provided_csrf_token[MAX_TOKEN_LENGTH + 1];
-    strncpy(provided_csrf_token, token_start, token_length);
-    provided_csrf_token[token_length] = '\0';
-
-    return (strcmp(expected_csrf_token, provided_csrf_token) == 0);
+    return slice_equals(provided_csrf_token, expected_csrf_token);
 }
\ No newline at end of file
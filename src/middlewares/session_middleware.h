@@ -8,9 +8,11 @@
 #define MAX_TOKEN_LENGTH 64
 
 
-QueryResult check_session(const char *headers, PGconn *conn, int *user_id, char *csrf_token);
+bool read_session_token(HttpRequest *req, char *session_token);
 
-QueryResult check_and_retrieve_session(const char *headers, PGconn *conn, int *user_id, char *csrf_token, char *session_token, size_t max_length);
+QueryResult check_session(HttpRequest *req, PGconn *conn, int *user_id, char *csrf_token);
+
+QueryResult check_and_retrieve_session(HttpRequest *req, PGconn *conn, int *user_id, char *csrf_token, char *session_token, size_t max_length);
 
 bool check_csrf_token(HttpRequest *req, const char *expected_csrf_token);
 
@@ -0,0 +1,70 @@
+#include "test_request.h"
+#include "encoding.h"
+#include <stdio.h>
+
+#define ALL_ENCODINGS (ENCODING_BIT(ENCODING_IDENTITY) | ENCODING_BIT(ENCODING_BR) | ENCODING_BIT(ENCODING_GZIP))
+#define GZIP_ONLY (ENCODING_BIT(ENCODING_IDENTITY) | ENCODING_BIT(ENCODING_GZIP))
+
+
+typedef struct {
+    const char *headers;
+    unsigned available;
+    ContentEncoding expected;
+} EncodingCase;
+
+static const EncodingCase CASES[] = {
+    {"", ALL_ENCODINGS, ENCODING_IDENTITY},
+    {"Accept-Encoding: gzip\r\n", ALL_ENCODINGS, ENCODING_GZIP},
+    {"Accept-Encoding: gzip, deflate, br, zstd\r\n", ALL_ENCODINGS, ENCODING_BR},
+    {"Accept-Encoding: gzip, deflate, br\r\n", GZIP_ONLY, ENCODING_GZIP},
+    {"Accept-Encoding: gzip\r\n", ENCODING_BIT(ENCODING_IDENTITY), ENCODING_IDENTITY},
+    {"Accept-Encoding: GZip\r\n", ALL_ENCODINGS, ENCODING_GZIP},
+    {"Accept-Encoding: x-gzip\r\n", ALL_ENCODINGS, ENCODING_GZIP},
+    {"Accept-Encoding: identity\r\n", ALL_ENCODINGS, ENCODING_IDENTITY},
+    {"Accept-Encoding: deflate\r\n", ALL_ENCODINGS, ENCODING_IDENTITY},
+
+    // qvalues, and q=0 turning a coding down
+    {"Accept-Encoding: gzip;q=1.0, br;q=0.5\r\n", ALL_ENCODINGS, ENCODING_GZIP},
+    {"Accept-Encoding: gzip; q=0.2, br; q=0.8\r\n", ALL_ENCODINGS, ENCODING_BR},
+    {"Accept-Encoding: br;q=0\r\n", ALL_ENCODINGS, ENCODING_IDENTITY},
+    {"Accept-Encoding: br;q=0.000, gzip\r\n", ALL_ENCODINGS, ENCODING_GZIP},
+    {"Accept-Encoding: gzip;q=0.001\r\n", ALL_ENCODINGS, ENCODING_GZIP},
+    {"Accept-Encoding: gzip;Q=0\r\n", ALL_ENCODINGS, ENCODING_IDENTITY},
+
+    // the wildcard stands in for every coding not named
+    {"Accept-Encoding: *\r\n", ALL_ENCODINGS, ENCODING_BR},
+    {"Accept-Encoding: *\r\n", GZIP_ONLY, ENCODING_GZIP},
+    {"Accept-Encoding: *;q=0\r\n", ALL_ENCODINGS, ENCODING_IDENTITY},
+    {"Accept-Encoding: br;q=0, *\r\n", ALL_ENCODINGS, ENCODING_GZIP},
+    {"Accept-Encoding: *, gzip;q=0\r\n", GZIP_ONLY, ENCODING_IDENTITY},
+    {"Accept-Encoding: gzip;q=0.5, *;q=0.9\r\n", ALL_ENCODINGS, ENCODING_BR},
+    {"Accept-Encoding: br, *;q=0\r\n", GZIP_ONLY, ENCODING_IDENTITY},
+};
+
+#define CASE_COUNT (sizeof(CASES) / sizeof(CASES[0]))
+
+
+static bool check(const EncodingCase *test) {
+    TestRequest request;
+    if (!test_request_parse(&request, test->headers)) {
+        fprintf(stderr, "Couldn't parse the request for %s", test->headers);
+        return false;
+    }
+    ContentEncoding encoding = negotiate_encoding(&request.request, test->available);
+    if (encoding != test->expected) {
+        fprintf(stderr, "%sgave %s instead of %s with %#x available\n", test->headers, encoding_name(encoding),
+                encoding_name(test->expected), test->available);
+        return false;
+    }
+    return true;
+}
+
+
+int main() {
+    int failed = 0;
+    for (size_t i = 0; i < CASE_COUNT; ++i) {
+        failed += !check(&CASES[i]);
+    }
+    printf("%zu encoding cases, %d failed\n", CASE_COUNT, failed);
+    return failed ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "test_request.h"
+#include "ranges.h"
+#include <stdio.h>
+
+#define SIZE 100
+
+
+typedef struct {
+    const char *headers;
+    RangeStatus status;
+    int count;
+    ByteRange ranges[3];
+} RangeCase;
+
+// all against a 100 byte representation
+static const RangeCase CASES[] = {
+    {"", RANGE_NONE, 0, {}},
+    {"Range: bytes=0-9\r\n", RANGE_SATISFIABLE, 1, {{0, 10}}},
+    {"Range: bytes=90-\r\n", RANGE_SATISFIABLE, 1, {{90, 100}}},
+    {"Range: bytes=95-200\r\n", RANGE_SATISFIABLE, 1, {{95, 100}}},
+    {"Range: BYTES=0-0\r\n", RANGE_SATISFIABLE, 1, {{0, 1}}},
+
+    // suffixes
+    {"Range: bytes=-10\r\n", RANGE_SATISFIABLE, 1, {{90, 100}}},
+    {"Range: bytes=-100\r\n", RANGE_SATISFIABLE, 1, {{0, 100}}},
+    {"Range: bytes=-500\r\n", RANGE_SATISFIABLE, 1, {{0, 100}}},
+    {"Range: bytes=-0\r\n", RANGE_UNSATISFIABLE, 0, {}},
+    {"Range: bytes=-\r\n", RANGE_NONE, 0, {}},
+
+    // several ranges, and ones that overlap into asking for more than the whole
+    {"Range: bytes=0-9, 20-29\r\n", RANGE_SATISFIABLE, 2, {{0, 10}, {20, 30}}},
+    {"Range: bytes=0-49,50-99\r\n", RANGE_SATISFIABLE, 2, {{0, 50}, {50, 100}}},
+    {"Range: bytes=0-9,5-14,-5\r\n", RANGE_SATISFIABLE, 3, {{0, 10}, {5, 15}, {95, 100}}},
+    {"Range: bytes=0-59,40-99\r\n", RANGE_NONE, 0, {}},
+    {"Range: bytes=0-,0-\r\n", RANGE_NONE, 0, {}},
+    {"Range: bytes=0-0,1-1,2-2,3-3,4-4,5-5,6-6,7-7,8-8,9-9,10-10,11-11,12-12,13-13,14-14,15-15,16-16\r\n",
+     RANGE_NONE, 0, {}},
+
+    // out of range: unsatisfiable only when no range is left
+    {"Range: bytes=100-\r\n", RANGE_UNSATISFIABLE, 0, {}},
+    {"Range: bytes=200-300\r\n", RANGE_UNSATISFIABLE, 0, {}},
+    {"Range: bytes=200-300, 0-0\r\n", RANGE_SATISFIABLE, 1, {{0, 1}}},
+
+    // malformed, or for another representation
+    {"Range: bytes=9-0\r\n", RANGE_NONE, 0, {}},
+    {"Range: bytes=\r\n", RANGE_NONE, 0, {}},
+    {"Range: bytes=a-b\r\n", RANGE_NONE, 0, {}},
+    {"Range: bytes=0-9;\r\n", RANGE_NONE, 0, {}},
+    {"Range: items=0-9\r\n", RANGE_NONE, 0, {}},
+    {"Range: bytes=0-9\r\nIf-Range: \"elsewhere\"\r\n", RANGE_NONE, 0, {}},
+};
+
+#define CASE_COUNT (sizeof(CASES) / sizeof(CASES[0]))
+
+
+static bool check(const RangeCase *test, const Validators *validators) {
+    TestRequest request;
+    if (!test_request_parse(&request, test->headers)) {
+        fprintf(stderr, "Couldn't parse the request for %s", test->headers);
+        return false;
+    }
+    ByteRange ranges[MAX_RANGES];
+    int count = 0;
+    RangeStatus status = request_ranges(&request.request, validators, SIZE, ranges, &count);
+    if (status != test->status) {
+        fprintf(stderr, "%sgave status %d instead of %d\n", test->headers, status, test->status);
+        return false;
+    }
+    if (status != RANGE_SATISFIABLE) {
+        return true;
+    }
+    if (count != test->count) {
+        fprintf(stderr, "%sgave %d ranges instead of %d\n", test->headers, count, test->count);
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (ranges[i].start != test->ranges[i].start || ranges[i].end != test->ranges[i].end) {
+            fprintf(stderr, "%sgave [%lld, %lld) instead of [%lld, %lld) for range %d\n", test->headers,
+                    (long long)ranges[i].start, (long long)ranges[i].end, (long long)test->ranges[i].start,
+                    (long long)test->ranges[i].end, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int main() {
+    Validators validators;
+    validators_init(&validators, SIZE, 1700000000, 0, ENCODING_IDENTITY);
+    int failed = 0;
+    for (size_t i = 0; i < CASE_COUNT; ++i) {
+        failed += !check(&CASES[i], &validators);
+    }
+    printf("%zu range cases, %d failed\n", CASE_COUNT, failed);
+    return failed ? 1 : 0;
+}
\ No newline at end of file
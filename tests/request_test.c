@@ -0,0 +1,167 @@
+#include "request.h"
+#include "tokenizer.h"
+#include <stdio.h>
+#include <string.h>
+
+
+typedef struct {
+    const char *name;
+    const char *data;
+    RequestParsingStatus status;
+} FeedCase;
+
+// each one a single request, fed whole and a byte at a time
+static const FeedCase FEED_CASES[] = {
+    {"GET", "GET /todos?page=2 HTTP/1.1\r\nHost: localhost\r\n\r\n", REQ_PARSE_SUCCESS},
+    {"POST with a body", "POST /todos HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello", REQ_PARSE_SUCCESS},
+    {"no headers", "GET / HTTP/1.0\r\n\r\n", REQ_PARSE_SUCCESS},
+    {"headers cut short", "GET / HTTP/1.1\r\nHost: localhost\r\n", REQ_PARSE_INCOMPLETE},
+    {"body cut short", "POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\nhello", REQ_PARSE_INCOMPLETE},
+    {"header over a 64 byte block",
+     "GET / HTTP/1.1\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\r\n"
+     "X-Later:value\r\n\r\n", REQ_PARSE_SUCCESS},
+
+    // Content-Length
+    {"repeated Content-Length", "POST / HTTP/1.1\r\nContent-Length: 2\r\nContent-Length: 2\r\n\r\nok",
+     REQ_PARSE_SUCCESS},
+    {"conflicting Content-Length", "POST / HTTP/1.1\r\nContent-Length: 2\r\nContent-Length: 3\r\n\r\nokk",
+     REQ_PARSE_INVALID_FORMAT},
+    {"signed Content-Length", "POST / HTTP/1.1\r\nContent-Length: +2\r\n\r\nok", REQ_PARSE_INVALID_FORMAT},
+    {"empty Content-Length", "POST / HTTP/1.1\r\nContent-Length:\r\n\r\n", REQ_PARSE_INVALID_FORMAT},
+    {"oversized Content-Length", "POST / HTTP/1.1\r\nContent-Length: 1048577\r\n\r\n", REQ_PARSE_BODY_TOO_LARGE},
+
+    // Transfer-Encoding
+    {"chunked", "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n",
+     REQ_PARSE_UNSUPPORTED_TRANSFER_ENCODING},
+    {"chunked and Content-Length", "POST / HTTP/1.1\r\nContent-Length: 5\r\nTransfer-Encoding: chunked\r\n\r\n"
+     "0\r\n\r\n", REQ_PARSE_INVALID_FORMAT},
+
+    // framing
+    {"bare LF", "GET / HTTP/1.1\nHost: localhost\n\n", REQ_PARSE_INVALID_FORMAT},
+    {"header without a colon", "GET / HTTP/1.1\r\nHost localhost\r\n\r\n", REQ_PARSE_INVALID_FORMAT},
+    {"space before the colon", "GET / HTTP/1.1\r\nHost : localhost\r\n\r\n", REQ_PARSE_INVALID_FORMAT},
+    {"empty request line", "\r\nGET / HTTP/1.1\r\n\r\n", REQ_PARSE_INVALID_FORMAT},
+};
+
+typedef struct {
+    const char *name;
+    const char *data;
+    int count;
+} PipelineCase;
+
+// requests sent back to back in one read, each framed off the front of what's left
+static const PipelineCase PIPELINE_CASES[] = {
+    {"two GETs", "GET /a HTTP/1.1\r\nHost: x\r\n\r\nGET /b HTTP/1.1\r\nHost: x\r\n\r\n", 2},
+    {"POST with a body that reads like a request",
+     "POST /a HTTP/1.1\r\nContent-Length: 4\r\n\r\nGET GET /b HTTP/1.1\r\n\r\n", 2},
+    {"three with a body in between",
+     "GET / HTTP/1.1\r\n\r\nPOST / HTTP/1.1\r\nContent-Length: 3\r\n\r\nabcGET / HTTP/1.1\r\n\r\n", 3},
+};
+
+#define FEED_CASE_COUNT (sizeof(FEED_CASES) / sizeof(FEED_CASES[0]))
+#define PIPELINE_CASE_COUNT (sizeof(PIPELINE_CASES) / sizeof(PIPELINE_CASES[0]))
+
+
+// the framing has to agree with itself whichever way the bytes arrive
+static bool check_feed(const FeedCase *test) {
+    size_t length = strlen(test->data);
+    RequestParser parser;
+    request_parser_reset(&parser);
+    RequestParsingStatus status = request_parser_feed(&parser, test->data, length);
+    if (status != test->status) {
+        fprintf(stderr, "%s: fed whole, gave status %d instead of %d\n", test->name, status, test->status);
+        return false;
+    }
+    if (status == REQ_PARSE_SUCCESS && request_parser_length(&parser) != length) {
+        fprintf(stderr, "%s: framed %zu of %zu bytes\n", test->name, request_parser_length(&parser), length);
+        return false;
+    }
+
+    request_parser_reset(&parser);
+    for (size_t received = 1; received <= length; ++received) {
+        status = request_parser_feed(&parser, test->data, received);
+        if (status == REQ_PARSE_SUCCESS && received < length) {
+            fprintf(stderr, "%s: complete after %zu of %zu bytes\n", test->name, received, length);
+            return false;
+        }
+    }
+    if (status != test->status) {
+        fprintf(stderr, "%s: fed a byte at a time, gave status %d instead of %d\n", test->name, status,
+                test->status);
+        return false;
+    }
+    return true;
+}
+
+
+static bool check_pipeline(const PipelineCase *test) {
+    const char *data = test->data;
+    size_t remaining = strlen(data);
+    int count = 0;
+    while (remaining > 0) {
+        RequestParser parser;
+        request_parser_reset(&parser);
+        HttpRequest request;
+        memset(&request, 0, sizeof(request));
+        if (request_parser_feed(&parser, data, remaining) != REQ_PARSE_SUCCESS ||
+            parse_http_request(data, &parser, &request) != REQ_PARSE_SUCCESS) {
+            fprintf(stderr, "%s: request %d didn't parse\n", test->name, count + 1);
+            return false;
+        }
+        size_t length = request_parser_length(&parser);
+        data += length;
+        remaining -= length;
+        count++;
+    }
+    if (count != test->count) {
+        fprintf(stderr, "%s: framed %d requests instead of %d\n", test->name, count, test->count);
+        return false;
+    }
+    return true;
+}
+
+
+static bool check_request_line() {
+    const char *data = "PATCH /todos/7?x=1 HTTP/1.1\r\nX-Custom: yes\r\nCookie: session=abc\r\n\r\n";
+    RequestParser parser;
+    request_parser_reset(&parser);
+    HttpRequest request;
+    memset(&request, 0, sizeof(request));
+    if (request_parser_feed(&parser, data, strlen(data)) != REQ_PARSE_SUCCESS ||
+        parse_http_request(data, &parser, &request) != REQ_PARSE_SUCCESS) {
+        fprintf(stderr, "The request line check didn't parse\n");
+        return false;
+    }
+    Slice cookie = request_header(&request, HDR_COOKIE);
+    Slice custom = request_header_named(&request, "x-custom");
+    if (request.method != PATCH || !slice_equals(request.path, "/todos/7") ||
+        !slice_equals(request.query_string, "x=1") || !slice_equals(request.protocol, "HTTP/1.1") ||
+        !cookie.ptr || !slice_equals(cookie, "session=abc") || !custom.ptr || !slice_equals(custom, "yes")) {
+        fprintf(stderr, "The request line or headers came out wrong\n");
+        return false;
+    }
+    return true;
+}
+
+
+int main() {
+    const TokenizerLevel levels[] = {TOKENIZER_SCALAR, TOKENIZER_SSE42, TOKENIZER_AVX2};
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); ++i) {
+        if (!tokenizer_use(levels[i])) {
+            continue;
+        }
+        int level_failed = 0;
+        for (size_t j = 0; j < FEED_CASE_COUNT; ++j) {
+            level_failed += !check_feed(&FEED_CASES[j]);
+        }
+        for (size_t j = 0; j < PIPELINE_CASE_COUNT; ++j) {
+            level_failed += !check_pipeline(&PIPELINE_CASES[j]);
+        }
+        level_failed += !check_request_line();
+        printf("%s: %zu request cases, %d failed\n", tokenizer_level_name(levels[i]),
+               FEED_CASE_COUNT + PIPELINE_CASE_COUNT + 1, level_failed);
+        failed += level_failed;
+    }
+    return failed ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#include "test_request.h"
+#include <stdio.h>
+#include <string.h>
+
+
+// headers are the lines after the request line, each with its CRLF; the blank line that ends them is added here
+bool test_request_parse(TestRequest *test, const char *headers) {
+    int length = snprintf(test->buffer, sizeof(test->buffer), "GET / HTTP/1.1\r\n%s\r\n", headers);
+    if (length < 0 || length >= (int)sizeof(test->buffer)) {
+        return false;
+    }
+    memset(&test->request, 0, sizeof(test->request));
+    request_parser_reset(&test->parser);
+    return request_parser_feed(&test->parser, test->buffer, length) == REQ_PARSE_SUCCESS &&
+           parse_http_request(test->buffer, &test->parser, &test->request) == REQ_PARSE_SUCCESS;
+}
\ No newline at end of file
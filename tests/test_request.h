@@ -0,0 +1,19 @@
+#ifndef HTTP_SERVER_TEST_REQUEST_H
+#define HTTP_SERVER_TEST_REQUEST_H
+
+#include "request.h"
+
+#define TEST_REQUEST_SIZE 4096
+
+
+// a request parsed the way the server parses one, for checks of code that reads its headers
+typedef struct {
+    char buffer[TEST_REQUEST_SIZE];
+    RequestParser parser;
+    HttpRequest request;
+} TestRequest;
+
+bool test_request_parse(TestRequest *test, const char *headers);
+
+
+#endif